@@ -24,6 +24,9 @@
 // $de01 Command register in KFF RAM
 #define KFF_COMMAND (*((volatile u8*)(KFF_RAM + 1)))
 
+// $de02 PRG pages ready for LOAD in KFF RAM (writes go to the control register)
+#define KFF_LOAD_PAGES (*((volatile u8*)(KFF_RAM + 2)))
+
 // $de04-$de05 Read buffer pointer register in KFF RAM
 #define KFF_READ_PTR (*((u16*)(KFF_RAM + 4)))
 
@@ -33,6 +36,19 @@
 // $de09 ID register in KFF RAM (same address as EF3 USB Control register)
 #define KFF_ID (*((u8*)(KFF_RAM + 9)))
 
+#define KFF_RESUME_NONE 0x10000
+
+// Special button will freeze the C64 (disk mode only)
+static bool kff_freeze_enabled;
+
+// Special button will swap disk instead if a disk list is mounted
+static bool kff_swap_enabled;
+static volatile bool kff_swap_pressed;
+static bool kff_rom_enabled;
+
+// Stack address of the PC high byte read by RTI when resuming a snapshot
+static u32 kff_resume_addr;
+
 static void kff_set_command(u8 cmd)
 {
     KFF_READ_PTR = 0;
@@ -96,6 +112,37 @@ FORCE_INLINE bool kff_read_handler(u32 control, u32 addr)
         return true;
     }
 
+    if (addr == kff_resume_addr)
+    {
+        // RTI has read the PC from the stack. Leave the snapshot code
+        C64_CRT_CONTROL(STATUS_LED_OFF|CRT_PORT_NONE);
+        kff_rom_enabled = false;
+        kff_resume_addr = KFF_RESUME_NONE;
+    }
+    else if (control & SPECIAL_BTN)
+    {
+        special_button = SPECIAL_PRESSED;
+    }
+    else if (special_button)
+    {
+        special_button = SPECIAL_RELEASED;
+
+        if (kff_swap_enabled)
+        {
+            kff_swap_pressed = true;
+        }
+        // Not while the disk API is using the KFF ROM
+        else if (kff_freeze_enabled && !kff_rom_enabled)
+        {
+            C64_CRT_CONTROL(C64_NMI_LOW);
+            freezer_state = FREEZE_START;
+        }
+    }
+    else if (freezer_state)
+    {
+        freezer_state = FREEZE_START;
+    }
+
     return false;
 }
 
@@ -104,6 +151,14 @@ FORCE_INLINE bool kff_read_handler(u32 control, u32 addr)
 ******************************************************************************/
 FORCE_INLINE bool kff_write_handler(u32 control, u32 addr, u32 data)
 {
+    // Use 3 consecutive writes to detect NMI
+    if (freezer_state && ++freezer_state == FREEZE_3_WRITES)
+    {
+        C64_CRT_CONTROL(STATUS_LED_ON|CRT_PORT_ULTIMAX|C64_NMI_HIGH);
+        freezer_state = FREEZE_RESET;
+        kff_rom_enabled = true;
+    }
+
     if (!(control & C64_IO1))
     {
         switch (addr & 0xff)
@@ -117,7 +172,12 @@ FORCE_INLINE bool kff_write_handler(u32 control, u32 addr, u32 data)
             case 0x02:  // $de02 Control register
             {
                 u32 mode;
-                if (data & 0x01)
+                if (data & 0x40)
+                {
+                    // Used when restoring a snapshot
+                    mode = STATUS_LED_ON|CRT_PORT_ULTIMAX;
+                }
+                else if (data & 0x01)
                 {
                     mode = STATUS_LED_ON|CRT_PORT_16K;
                 }
@@ -125,6 +185,7 @@ FORCE_INLINE bool kff_write_handler(u32 control, u32 addr, u32 data)
                 {
                     mode = STATUS_LED_OFF|CRT_PORT_NONE;
                 }
+                kff_rom_enabled = (data & 0x41) != 0;
                 C64_CRT_CONTROL(mode);
             }
             break;
@@ -148,14 +209,18 @@ static void kff_init(void)
 
     KFF_ID = KFF_ID_VALUE;
     kff_set_command(CMD_NONE);
+
+    kff_freeze_enabled = false;
+    kff_rom_enabled = true;
+    kff_resume_addr = KFF_RESUME_NONE;
 }
 
 static void kff_reu_handler(void);
 
-static void kff_reu_init(void)
+static void kff_reu_init(u32 size)
 {
     kff_init();
-    reu_handler_init(kff_reu_handler);
+    reu_handler_init(kff_reu_handler, size);
 }
 
 // REU support and allow SDIO and USB to be used while handling C64 bus access
@@ -33,7 +33,8 @@
 #define REU_REG_SHADOW  (REU_REG + 0x20)
 #define REU_REG_MASK    (REU_REG + 0x40)
 
-#define REU_BASE_MASK   (0xfffff) // 1MB of RAM
+#define REU_MAX_SIZE    (1024*1024)
+#define REU_MIN_SIZE    (128*1024)
 
 typedef struct
 {
@@ -57,6 +58,7 @@ typedef struct
     void (* c64_handler)(void);
 
     u32 *auto_ptr;
+    u32 base_mask;          // REU size - 1
     u8 c64_inc;
     u8 reu_inc;
     u8 temp;
@@ -194,8 +196,8 @@ FORCE_INLINE void reu_read_dma_bus_handler(void)
     C64_ADDR_WRITE(REU->c64_base);
     REU->c64_base += REU->c64_inc;
 
-    u8 *reu_ptr = REU_BUF + (REU->reu_base & REU_BASE_MASK);
-    REU->reu_base = (REU->reu_base & REU_BASE_MASK) + REU->reu_inc;
+    u8 *reu_ptr = REU_BUF + (REU->reu_base & REU->base_mask);
+    REU->reu_base = (REU->reu_base & REU->base_mask) + REU->reu_inc;
 
     if (REU->trans_len != 1)
     {
@@ -237,11 +239,11 @@ FORCE_INLINE void reu_write_dma_bus_handler(void)
 {
     C64_ADDR_WRITE(REU->c64_base);
     C64_CONTROL_WRITE(C64_WRITE_LOW);
-    u8 data = REU_BUF[REU->reu_base & REU_BASE_MASK];
+    u8 data = REU_BUF[REU->reu_base & REU->base_mask];
     C64_DATA_WRITE(data);
 
     REU->c64_base += REU->c64_inc;
-    REU->reu_base = (REU->reu_base & REU_BASE_MASK) + REU->reu_inc;
+    REU->reu_base = (REU->reu_base & REU->base_mask) + REU->reu_inc;
 
     if (REU->trans_len != 1)
     {
@@ -278,8 +280,8 @@ FORCE_INLINE void reu_swap_dma_bus_handler(void)
 {
     C64_ADDR_WRITE(REU->c64_base);
 
-    u8 *reu_ptr = REU_BUF + (REU->reu_base & REU_BASE_MASK);
-    REU->reu_base = (REU->reu_base & REU_BASE_MASK) + REU->reu_inc;
+    u8 *reu_ptr = REU_BUF + (REU->reu_base & REU->base_mask);
+    REU->reu_base = (REU->reu_base & REU->base_mask) + REU->reu_inc;
     REU->temp = *reu_ptr;
 
     C64_DMA_DATA_READ();
@@ -335,8 +337,8 @@ FORCE_INLINE void reu_verify_dma_bus_handler(void)
     C64_ADDR_WRITE(REU->c64_base);
     REU->c64_base += REU->c64_inc;
 
-    u8 *reu_ptr = REU_BUF + (REU->reu_base & REU_BASE_MASK);
-    REU->reu_base = (REU->reu_base & REU_BASE_MASK) + REU->reu_inc;
+    u8 *reu_ptr = REU_BUF + (REU->reu_base & REU->base_mask);
+    REU->reu_base = (REU->reu_base & REU->base_mask) + REU->reu_inc;
     u8 reu_data = *reu_ptr;
 
     if (REU->trans_len != 1)
@@ -386,7 +388,7 @@ FORCE_INLINE void reu_verify_dma_bus_handler(void)
 FORCE_INLINE void reu_verify_error_dma_bus_handler(void)
 {
     C64_ADDR_WRITE(REU->c64_base);
-    u8 reu_data = REU_BUF[REU->reu_base & REU_BASE_MASK];
+    u8 reu_data = REU_BUF[REU->reu_base & REU->base_mask];
 
     bool last_byte = REU->trans_len == 1;
     COMPILER_BARRIER();
@@ -419,7 +421,7 @@ FORCE_INLINE void reu_verify_error_dma_bus_handler(void)
     C64_CRT_CONTROL(crt_control);
 }
 
-static void reu_handler_init(void (c64_handler) (void))
+static void reu_handler_init(void (c64_handler) (void), u32 size)
 {
     REU->c64_handler = c64_handler;
 
@@ -432,19 +434,20 @@ static void reu_handler_init(void (c64_handler) (void))
     REU_SHADOW->trans_len = 0xffff;
 
     // Status register - 0x10 = 1764 (256k) or 1750 (512k) - 0x00 = 1700 (128k)
-    REU_REG_MASK[0x00] = 0x10;
+    REU_REG_MASK[0x00] = size > REU_MIN_SIZE ? 0x10 : 0x00;
     REU_REG_MASK[0x06] = 0xf8;  // REU bank pointer - The 8726 only has 3 bits
     REU_REG_MASK[0x09] = 0x1f;  // Interrupt mask register
     REU_REG_MASK[0x0a] = 0x3f;  // Address control register
 
     REU->auto_ptr = REU_CMD32;
+    REU->base_mask = size - 1;  // REU address wraps around at the size
     REU->c64_inc = 1;
     REU->reu_inc = 1;
 }
 
-static void reu_init(void)
+static void reu_init(u32 size)
 {
-    reu_handler_init(reu_handler);
+    reu_handler_init(reu_handler, size);
     C64_CRT_CONTROL(STATUS_LED_ON|CRT_PORT_NONE);
 }
 
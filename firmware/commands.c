@@ -67,6 +67,7 @@ static void c64_wait_for_command(u8 cmd)
     u8 reply;
     while (!c64_get_reply(cmd, &reply))
     {
+        log_poll();
         if (c64_wait_handler && !c64_wait_handler())
         {
             c64_set_command(CMD_NONE);
@@ -237,12 +238,6 @@ static void c64_send_text_wait(u8 color, u8 x, u8 y, const char *text)
     c64_send_command(CMD_TEXT_WAIT);
 }
 
-static void c64_send_text_reader(const char *text, u16 max_len)
-{
-    c64_send_petscii(text, max_len);
-    c64_send_command(CMD_TEXT_READER);
-}
-
 static void c64_send_message_command(u8 cmd, const char *text)
 {
     c64_send_petscii_line(text);
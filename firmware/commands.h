@@ -56,12 +56,15 @@ typedef enum
 
     CMD_MOUNT_DISK,
     CMD_WAIT_RESET,     // Disable screen and wait for reset
+    CMD_SNAPSHOT,       // Restore I/O state and resume snapshot
+    CMD_TEXT_PAGE,      // Text reader page
 
     // Disk commands
     CMD_NO_DRIVE = 0x10,
     CMD_DISK_ERROR,
     CMD_NOT_FOUND,
     CMD_END_OF_FILE,
+    CMD_VERIFY_ERROR,
 
     // SYNC commands
     CMD_WAIT_SYNC = 0x50,
@@ -83,6 +86,7 @@ typedef enum
     REPLY_BASIC_C128,
 
     REPLY_RESET,
+    REPLY_TEXT_PAGE,
 
     // Disk replies
     REPLY_LOAD = 0x90,
@@ -97,7 +101,10 @@ typedef enum
 
     REPLY_LISTEN,
     REPLY_UNLISTEN,
-    REPLY_RECEIVE_BYTE
+    REPLY_RECEIVE_BYTE,
+
+    REPLY_SNAPSHOT,     // C64 is frozen in snapshot code
+    REPLY_VERIFY        // C64 waits with all RAM visible
 } COMMAND_TYPE;
 
 typedef enum
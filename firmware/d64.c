@@ -68,7 +68,8 @@ static FSIZE_t d81_get_offset(D64_TS ts)
                     D64_SECTOR_LEN;
 }
 
-static bool d64_seek(D64_IMAGE *image, D64_TS ts)
+// All sectors must be within the image (never past the sector data)
+static bool d64_seek_sectors(D64_IMAGE *image, D64_TS ts, u8 count)
 {
     FSIZE_t offset;
     if (image->type == D64_TYPE_D81)
@@ -80,7 +81,10 @@ static bool d64_seek(D64_IMAGE *image, D64_TS ts)
         offset = d64_get_offset(image, ts);
     }
 
-    if (offset >= f_size(&image->file) || !file_seek(&image->file, offset))
+    FSIZE_t data_size = d64_get_data_size(f_size(&image->file));
+    if (offset >= data_size ||
+        offset + (FSIZE_t)count * D64_SECTOR_LEN > data_size ||
+        !file_seek(&image->file, offset))
     {
         wrn("Failed to seek to track %u sector %u", ts.track, ts.sector);
         return false;
@@ -89,6 +93,11 @@ static bool d64_seek(D64_IMAGE *image, D64_TS ts)
     return true;
 }
 
+static inline bool d64_seek(D64_IMAGE *image, D64_TS ts)
+{
+    return d64_seek_sectors(image, ts, 1);
+}
+
 static bool d64_seek_read(D64_IMAGE *image, void *buffer, D64_TS ts)
 {
     return d64_seek(image, ts) &&
@@ -130,6 +139,22 @@ static bool d64_write_sector(D64 *d64, void *buffer, D64_TS ts)
     return d64_seek_write(d64->image, buffer, ts) && d64_sync(d64->image);
 }
 
+// Sectors are read and written in image order (may span several tracks)
+static bool d64_read_sectors(D64 *d64, void *buffer, D64_TS ts, u8 count)
+{
+    u32 size = count * D64_SECTOR_LEN;
+    return d64_seek_sectors(d64->image, ts, count) &&
+           file_read(&d64->image->file, buffer, size) == size;
+}
+
+static bool d64_write_sectors(D64 *d64, void *buffer, D64_TS ts, u8 count)
+{
+    u32 size = count * D64_SECTOR_LEN;
+    return d64_seek_sectors(d64->image, ts, count) &&
+           file_write(&d64->image->file, buffer, size) == size &&
+           d64_sync(d64->image);
+}
+
 static bool d64_write_to(D64 *d64, D64_SECTOR *sector, D64_TS ts)
 {
     return d64_seek_write(d64->image, &sector->next, ts);
@@ -562,6 +587,21 @@ static bool d64_deallocate(D64 *d64, D64_TS ts)
     return d64_header_deallocate(entry, ts.sector);
 }
 
+static bool d64_allocate_sector(D64 *d64, D64_TS ts)
+{
+    if (d64->image->type == D64_TYPE_D81)
+    {
+        return d81_allocate(d64, ts);
+    }
+
+    if (d64->image->type == D64_TYPE_D71 && ts.track > D64_TRACKS)
+    {
+        return d71_allocate_36_70(d64, ts);
+    }
+
+    return d64_allocate(d64, ts);
+}
+
 static bool d64_deallocate_sector(D64 *d64, D64_TS ts)
 {
     if (d64->image->type == D64_TYPE_D81)
@@ -599,7 +639,10 @@ static bool d64_delete_file(D64 *d64, D64_DIR_ENTRY *entry)
         return false;
     }
 
+    // Keep the dir sector so reading the directory can continue
+    D64_SECTOR dir_sector = d64->sector;
     d64_deallocate_file(d64, entry);
+    d64->sector = dir_sector;
 
     // write updated BAM back to disk
     return d64_write_bam(d64) && d64_sync(d64->image);
@@ -676,48 +719,56 @@ static u8 d64_get_sectors(D64 *d64, u8 track)
     }
 }
 
-static bool d64_find_free_sector(D64 *d64, D64_TS *ts, u8 interleave)
+// Returns the BAM bitmap of the track with a bit set for each free sector
+static u64 d64_get_free_bitmap(D64 *d64, u8 track, u8 sectors)
 {
-    u8 sectors = d64_get_sectors(d64, ts->track);
+    u8 *data;
+    if (d64->image->type == D64_TYPE_D81)
+    {
+        data = d81_get_bam_entry(d64, track)->data;
+    }
+    else if (d64->image->type == D64_TYPE_D71 && track > D64_TRACKS)
+    {
+        data = d64->image->d71_bam.entries[track - D64_TRACKS - 1].data;
+    }
+    else
+    {
+        data = d64_get_bam_entry(d64, track)->data;
+    }
 
-    for (int count=0; count<sectors; count++)
+    u64 bitmap = 0;
+    for (u8 i=0; i<(sectors + 7) / 8; i++)
     {
-        ts->sector += interleave;
-        if (ts->sector > sectors)
-        {
-            ts->sector -= (sectors + 1);
-        }
-        else if (ts->sector == sectors)
-        {
-            ts->sector = 0;
-        }
+        bitmap |= (u64)data[i] << (i * 8);
+    }
 
-        if (d64->image->type == D64_TYPE_D81)
-        {
-            if (d81_allocate(d64, *ts))
-            {
-                return true;
-            }
-        }
-        else if (d64->image->type == D64_TYPE_D71 && ts->track > D64_TRACKS)
-        {
-            if (d71_allocate_36_70(d64, *ts))
-            {
-                return true;
-            }
-        }
-        else
-        {
-            if (d64_allocate(d64, *ts))
-            {
-                return true;
-            }
-        }
+    return bitmap & (((u64)1 << sectors) - 1);
+}
 
-        interleave = 1;
+static bool d64_find_free_sector(D64 *d64, D64_TS *ts, u8 interleave)
+{
+    u8 sectors = d64_get_sectors(d64, ts->track);
+    u64 bitmap = d64_get_free_bitmap(d64, ts->track, sectors);
+    if (!bitmap)
+    {
+        return false;
     }
 
-    return false;
+    u8 sector = ts->sector + interleave;
+    if (sector > sectors)
+    {
+        sector -= (sectors + 1);
+    }
+    else if (sector == sectors)
+    {
+        sector = 0;
+    }
+
+    // Use the first free sector from the interleaved sector and wrap around
+    u64 next_free = bitmap & (~(u64)0 << sector);
+    ts->sector = __builtin_ctzll(next_free ? next_free : bitmap);
+
+    return d64_allocate_sector(d64, *ts);
 }
 
 static bool d64_find_free_track_sector(D64 *d64, D64_TS *ts)
@@ -807,6 +858,12 @@ static void d64_pad_filename(char *dest, const char *src)
     }
 }
 
+static bool d64_rename_file(D64 *d64, D64_DIR_ENTRY *entry, const char *filename)
+{
+    d64_pad_filename(entry->filename, filename);
+    return d64_write_current(d64) && d64_sync(d64->image);
+}
+
 static bool d64_is_valid_dos_version(D64 *d64)
 {
     u8 version = d64->image->d64_header.dos_version;
@@ -976,3 +1033,240 @@ static bool d64_open(D64_IMAGE *image, const char *filename)
 
     return d64_read_header(image);
 }
+
+static FSIZE_t d64_get_image_size(u8 type)
+{
+    switch (type)
+    {
+        case D64_TYPE_D81:
+            return (FSIZE_t)D81_TRACKS * D81_SECTORS * D64_SECTOR_LEN;
+
+        case D64_TYPE_D71:
+            return (FSIZE_t)d64_track_offset[D64_TRACKS] * D64_SECTOR_LEN * 2;
+
+        default:
+            return (FSIZE_t)d64_track_offset[D64_TRACKS] * D64_SECTOR_LEN;
+    }
+}
+
+// Clear all sectors using large sequential writes
+static bool d64_clear_image(D64_IMAGE *image)
+{
+    memset(scratch_buf, 0, sizeof(scratch_buf));
+    if (!file_seek(&image->file, 0))
+    {
+        return false;
+    }
+
+    FSIZE_t size = d64_get_image_size(image->type);
+    while (size)
+    {
+        u32 len = size < sizeof(scratch_buf) ? size : sizeof(scratch_buf);
+        if (file_write(&image->file, scratch_buf, len) != len)
+        {
+            return false;
+        }
+
+        size -= len;
+    }
+
+    return true;
+}
+
+// Mark all sectors in the track as free
+static u8 d64_format_bitmap(u8 *bitmap, u8 sectors)
+{
+    for (u8 i=0; i<sectors; i++)
+    {
+        bitmap[i >> 3] |= 1 << (i & 0x07);
+    }
+
+    return sectors;
+}
+
+static void d64_init_diskname(char *dest, const char *diskname,
+                              const char *id, const char *dos_type)
+{
+    memset(dest, '\xa0', 27);
+    d64_pad_filename(dest, diskname);
+    dest[18] = id[0];
+    dest[19] = id[1];
+    dest[21] = dos_type[0];
+    dest[22] = dos_type[1];
+}
+
+static void d81_format_bam(D81_BAM_SECTOR *bam, D64_TS ts, const char *id)
+{
+    bam->current = ts;
+    bam->version = D81_DOS_VERSION | (~D81_DOS_VERSION & 0xff) << 8;
+    memcpy(&bam->disk_id, id, sizeof(bam->disk_id));
+    bam->io_byte = 0xc0;
+
+    for (u8 i=0; i<ARRAY_COUNT(bam->entries); i++)
+    {
+        D81_BAM_ENTRY *entry = &bam->entries[i];
+        entry->free_sectors = d64_format_bitmap(entry->data, D81_SECTORS);
+    }
+}
+
+static void d81_format_header(D64 *d64, const char *diskname, const char *id)
+{
+    D64_IMAGE *image = d64->image;
+    D64_TS ts = {D81_TRACK_DIR, D64_SECTOR_HEADER};
+
+    D81_HEADER_SECTOR *header = &image->d81_header;
+    header->current = ts;
+    header->next.track = D81_TRACK_DIR;
+    header->next.sector = D81_SECTOR_DIR;
+    header->dos_version = D81_DOS_VERSION;
+    d64_init_diskname(header->diskname, diskname, id, "3D");
+    header->diskname[25] = header->diskname[26] = 0;
+
+    ts.sector++;
+    d81_format_bam(&image->d81_bam1, ts, id);
+    image->d81_bam1.next.track = D81_TRACK_DIR;
+    image->d81_bam1.next.sector = ts.sector + 1;
+
+    ts.sector++;
+    d81_format_bam(&image->d81_bam2, ts, id);
+    image->d81_bam2.next.sector = 0xff;
+
+    // Header, BAM and first directory sector
+    for (ts.sector=0; ts.sector<=D81_SECTOR_DIR; ts.sector++)
+    {
+        d81_allocate(d64, ts);
+    }
+}
+
+static void d64_format_header(D64 *d64, const char *diskname, const char *id)
+{
+    D64_IMAGE *image = d64->image;
+    D64_TS ts = {D64_TRACK_DIR, D64_SECTOR_HEADER};
+
+    D64_HEADER_SECTOR *header = &image->d64_header;
+    header->current = ts;
+    header->next.track = D64_TRACK_DIR;
+    header->next.sector = D64_SECTOR_DIR;
+    header->dos_version = D64_DOS_VERSION;
+    d64_init_diskname(header->diskname, diskname, id, "2A");
+
+    for (u8 track=1; track<=D64_TRACKS; track++)
+    {
+        D64_BAM_ENTRY *entry = d64_get_bam_entry(d64, track);
+        entry->free_sectors = d64_format_bitmap(entry->data,
+                                                d64_get_sectors(d64, track));
+    }
+
+    d64_allocate(d64, ts);
+    ts.sector = D64_SECTOR_DIR;
+    d64_allocate(d64, ts);
+
+    if (image->type != D64_TYPE_D71)
+    {
+        return;
+    }
+
+    header->double_sided = 0x80;
+    image->d71_bam.current.track = D64_TRACK_DIR + D64_TRACKS;
+    image->d71_bam.current.sector = D64_SECTOR_HEADER;
+
+    for (u8 track=1; track<=D64_TRACKS; track++)
+    {
+        D71_BAM_ENTRY *entry = &image->d71_bam.entries[track-1];
+        header->free_sectors_36_70[track-1] =
+            d64_format_bitmap(entry->data, d64_get_sectors(d64, track));
+    }
+
+    // Track 53 is reserved for the BAM on the second side
+    ts.track = D64_TRACK_DIR + D64_TRACKS;
+    u8 sectors = d64_get_sectors(d64, ts.track);
+    for (ts.sector=0; ts.sector<sectors; ts.sector++)
+    {
+        d71_allocate_36_70(d64, ts);
+    }
+}
+
+// Write an empty header, BAM and directory. All other sectors are cleared
+// as well if a new disk ID is specified
+static bool d64_format(D64_IMAGE *image, const char *diskname, const char *id)
+{
+    D64 d64;
+    d64_init(image, &d64);
+
+    char disk_id[2];
+    if (id)
+    {
+        disk_id[0] = id[0];
+        disk_id[1] = id[0] ? id[1] : 0;
+
+        if (!d64_clear_image(image))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        memcpy(disk_id, d64_get_diskname(&d64) + 18, sizeof(disk_id));
+    }
+
+    // A missing ID would end the header line of the directory listing
+    for (u8 i=0; i<sizeof(disk_id); i++)
+    {
+        if (!disk_id[i])
+        {
+            disk_id[i] = '0';
+        }
+    }
+
+    memset(&image->header, 0, sizeof(image->header));
+    memset(&image->bam, 0, sizeof(image->bam));
+    memset(&image->bam2, 0, sizeof(image->bam2));
+
+    D64_SECTOR *dir = &d64.sector;
+    memset(dir, 0, sizeof(D64_SECTOR));
+    dir->next.sector = 0xff;
+
+    if (image->type == D64_TYPE_D81)
+    {
+        d81_format_header(&d64, diskname, disk_id);
+        dir->current.track = D81_TRACK_DIR;
+        dir->current.sector = D81_SECTOR_DIR;
+
+        D64_SECTOR *header = &image->header;
+        if (!d64_write_to(&d64, header, header->current))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        d64_format_header(&d64, diskname, disk_id);
+        dir->current.track = D64_TRACK_DIR;
+        dir->current.sector = D64_SECTOR_DIR;
+    }
+
+    return d64_write_current(&d64) && d64_write_bam(&d64) && d64_sync(image);
+}
+
+// Create and format a new image file. Clusters are allocated contiguously
+// when possible
+static bool d64_create(D64_IMAGE *image, const char *filename, u8 type,
+                       const char *diskname, const char *id)
+{
+    if (!file_open(&image->file, filename, FA_READ|FA_WRITE|FA_CREATE_NEW))
+    {
+        return false;
+    }
+
+    image->type = type;
+    file_expand(&image->file, d64_get_image_size(type));
+
+    bool result = d64_format(image, diskname, id ? id : "");
+    result &= d64_close(image);
+    if (!result)
+    {
+        file_delete(filename);
+    }
+
+    return result;
+}
@@ -87,6 +87,22 @@ static u8 d64_get_type(FSIZE_t imgsize)
     return D64_TYPE_UNKNOWN;
 }
 
+// Size of the sector data without the error info (if any)
+static FSIZE_t d64_get_data_size(FSIZE_t imgsize)
+{
+    switch (imgsize)
+    {
+        case 175531:  // 35 w/ errors
+        case 197376:  // 40 w/ errors
+        case 206114:  // 42 w/ errors
+        case 351062:  // 70 w/ errors
+        case 822400:  // 80 w/ errors
+            return imgsize / (D64_SECTOR_LEN + 1) * D64_SECTOR_LEN;
+    }
+
+    return imgsize;
+}
+
 typedef enum
 {
   D64_FILE_DEL      = 0x00,
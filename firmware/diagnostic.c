@@ -134,6 +134,47 @@ static bool diag_send_result(bool saving)
     return true;
 }
 
+static u32 diag_read_latency(const volatile u8 *buf, u32 size)
+{
+    u32 worst = 0;
+
+    __disable_irq();
+    for (u32 i=0; i<size; i+=32)    // One read per cache line
+    {
+        u32 start = DWT->CYCCNT;
+        (void)buf[i];
+        __DSB();
+        u32 cycles = DWT->CYCCNT - start;
+
+        if (cycles > worst)
+        {
+            worst = cycles;
+        }
+    }
+    __enable_irq();
+
+    return worst;
+}
+
+static void diag_send_region_latency(const char *name, const u8 *buf, u32 size)
+{
+    // Measure with cold cache first and then with the region cached
+    SCB_CleanInvalidateDCache();
+    u32 cold = diag_read_latency(buf, size);
+    u32 warm = diag_read_latency(buf, size);
+
+    sprint(scratch_buf, "%12s: %u/%u cycles\r\n", name, cold, warm);
+    usb_send_text(scratch_buf);
+}
+
+static void diag_send_latency(void)
+{
+    usb_send_text("Worst-case read latency (cold/warm)\r\n");
+    diag_send_region_latency("crt_buf", crt_buf, 16*1024);
+    diag_send_region_latency("dat_buf", dat_buf, sizeof(dat_buf));
+    diag_send_region_latency("crt_ram_buf", crt_ram_buf, sizeof(crt_ram_buf));
+}
+
 NO_RETURN diag_save_and_restart(s8 offset)
 {
     load_cfg();
@@ -203,6 +244,7 @@ static void diag_handle_button(void)
 static void diag_loop(void)
 {
     usb_send_text(diag_header);
+    diag_send_latency();
     c64_wait_handler = diag_timeout_handler;
 
     if (diag_button_pressed() & SPECIAL_BTN)
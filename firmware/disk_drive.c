@@ -234,14 +234,29 @@ static void disk_open_dir_read(DISK_CHANNEL *channel)
     channel->buf_mode = DISK_BUF_USE;
 }
 
+// Direct access channel using the multi-block buffer (opened with "#T")
+static DISK_CHANNEL *disk_block_channel;
+
+static inline u8 * disk_channel_buf(DISK_CHANNEL *channel)
+{
+    return channel == disk_block_channel ? DISK_BLOCK_BUF : channel->buf;
+}
+
+static inline u16 disk_channel_buf_size(DISK_CHANNEL *channel)
+{
+    return channel == disk_block_channel ?
+        DISK_BLOCK_BUF_SIZE : sizeof(channel->buf);
+}
+
 static size_t disk_read_data(DISK_CHANNEL *channel, u8 *buf, size_t buf_size)
 {
     if (channel->buf_mode)
     {
+        u8 *channel_buf = disk_channel_buf(channel);
         size_t read_bytes = 0;
         while (read_bytes < buf_size && channel->buf_ptr < channel->buf_len)
         {
-            *buf++ = channel->buf[channel->buf_ptr++];
+            *buf++ = channel_buf[channel->buf_ptr++];
             read_bytes++;
         }
 
@@ -312,6 +327,17 @@ static bool disk_delete_file(DISK_CHANNEL *channel, D64_DIR_ENTRY *entry)
     return fs_delete_file(channel, entry);
 }
 
+static bool disk_rename_file(DISK_CHANNEL *channel, D64_DIR_ENTRY *entry,
+                             const char *filename)
+{
+    if (cfg_file.img.mode)
+    {
+        return d64_rename_file(&channel->d64, entry, filename);
+    }
+
+    return fs_rename_file(channel, entry, filename);
+}
+
 static void disk_put_dir_header(DISK_CHANNEL *channel, u8 **ptr)
 {
     put_u16(ptr, dir_start_addr);       // start address
@@ -357,10 +383,22 @@ static void disk_put_dir_footer(DISK_CHANNEL *channel, u8 **ptr)
 
 static void disk_create_dir_prg(DISK_CHANNEL *channel, u8 **ptr)
 {
+    bool fs_mode = !cfg_file.img.mode;
+    if (fs_mode && fs_dir_cache_get(channel, ptr))
+    {
+        return;
+    }
+
+    u8 *start = *ptr;
     disk_put_dir_header(channel, ptr);
     // Limit dir to 1000 entries (~32k)
     for (u32 i=0; i<1000 && disk_put_dir_entry(channel, ptr); i++);
     disk_put_dir_footer(channel, ptr);
+
+    if (fs_mode)
+    {
+        fs_dir_cache_put(channel, start, *ptr);
+    }
 }
 
 static void disk_parse_filename(char *filename, PARSED_FILENAME *parsed)
@@ -465,12 +503,36 @@ static bool disk_is_file_supported(char *filename, PARSED_FILENAME *parsed)
     return true;
 }
 
+static bool disk_has_wildcard(const char *filename)
+{
+    for (u8 i=0; i<16 && filename[i]; i++)
+    {
+        if (filename[i] == '*' || filename[i] == '?')
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static D64_DIR_ENTRY * disk_find_file(DISK_CHANNEL *channel,
                                       const char *filename, u8 file_type)
 {
+    D64_DIR_ENTRY *entry;
+    if (!cfg_file.img.mode && !disk_has_wildcard(filename) &&
+        fs_find_file(channel, filename, &entry))
+    {
+        if (entry && file_type && !disk_is_file_type(entry, file_type))
+        {
+            return NULL;
+        }
+
+        return entry;
+    }
+
     disk_rewind_dir(channel);
 
-    D64_DIR_ENTRY *entry;
     while ((entry = disk_read_dir(channel)))
     {
         if (file_type && !disk_is_file_type(entry, file_type))
@@ -502,6 +564,53 @@ static bool disk_open_read(DISK_CHANNEL *channel, const char *filename,
     return false;
 }
 
+// PRG being read from the SD card while the C64 is loading it (FS mode)
+#define DISK_LOAD_CHUNK (4*1024)
+
+static DISK_CHANNEL *disk_load_channel;
+static u32 disk_load_ptr;
+static u32 disk_load_end;
+
+static void disk_load_set_pages(void)
+{
+    if (disk_load_ptr >= disk_load_end)
+    {
+        KFF_LOAD_PAGES = 0xff;  // All loaded
+        disk_load_channel = NULL;
+        return;
+    }
+
+    // Pages of PRG data ready after the 4 byte header
+    u32 pages = disk_load_ptr > 4 ? (disk_load_ptr - 4) >> 8 : 0;
+    KFF_LOAD_PAGES = pages < 0xff ? pages : 0xfe;
+}
+
+// Called while waiting for a reply from the C64
+static void disk_load_poll(void)
+{
+    if (!disk_load_channel)
+    {
+        return;
+    }
+
+    u32 len = disk_load_end - disk_load_ptr;
+    if (len > DISK_LOAD_CHUNK)
+    {
+        len = DISK_LOAD_CHUNK;
+    }
+
+    u8 *ptr = KFF_BUF + disk_load_ptr;
+    if (fs_read_data(disk_load_channel, ptr, len) != len)
+    {
+        // Let the C64 finish the load rather than hang
+        wrn("Failed to read PRG");
+        len = disk_load_end - disk_load_ptr;
+    }
+
+    disk_load_ptr += len;
+    disk_load_set_pages();
+}
+
 static u8 disk_handle_load_prg(DISK_CHANNEL *channel)
 {
     PARSED_FILENAME parsed;
@@ -516,7 +625,24 @@ static u8 disk_handle_load_prg(DISK_CHANNEL *channel)
     }
 
     u8 *ptr = KFF_BUF;
-    u16 prg_size = disk_read_data(channel, ptr + 2, 64*1024 - 2);
+    u32 prg_size, read_size;
+    if (cfg_file.img.mode)
+    {
+        // The size is not known before the whole file has been read
+        prg_size = read_size = disk_read_data(channel, ptr + 2, 64*1024 - 2);
+    }
+    else
+    {
+        // Read the first part now and the rest while the C64 is loading
+        FSIZE_t size = fs_get_size(channel);
+        prg_size = size < 64*1024 - 2 ? size : 64*1024 - 2;
+        read_size = prg_size < DISK_LOAD_CHUNK ? prg_size : DISK_LOAD_CHUNK;
+        if (disk_read_data(channel, ptr + 2, read_size) != read_size)
+        {
+            return CMD_DISK_ERROR;
+        }
+    }
+
     if (prg_size < 2)
     {
         return CMD_DISK_ERROR;
@@ -524,6 +650,11 @@ static u8 disk_handle_load_prg(DISK_CHANNEL *channel)
 
     *(u16 *)ptr = prg_size  - 2;
 
+    disk_load_ptr = read_size + 2;
+    disk_load_end = prg_size + 2;
+    disk_load_channel = channel;
+    disk_load_set_pages();
+
     dbg("Sending PRG. Start $%x size %u", *(u16 *)(ptr + 2), prg_size);
 
     return CMD_NONE;
@@ -628,6 +759,11 @@ static void disk_close_channel(DISK_CHANNEL *channel)
         c64_interface_sync();
     }
 
+    if (channel == disk_block_channel)
+    {
+        disk_block_channel = NULL;
+    }
+
     channel->buf_mode = DISK_BUF_USE;
     channel->buf_ptr = 0;
     channel->buf_len = 0;
@@ -646,8 +782,47 @@ static void disk_init_all_channels(D64_IMAGE *image, DISK_CHANNEL *channels)
     }
 }
 
+// Mount the next image in the disk list
+static void disk_swap_next(DISK_CHANNEL *channels)
+{
+    for (u32 i=0; i<16; i++)
+    {
+        if (channels[i].buf_mode == DISK_BUF_SAVE)
+        {
+            wrn("Cannot swap disk while a file is being written");
+            return;
+        }
+    }
+
+    u8 next = disk_swap.current + 1;
+    if (next >= disk_swap.count)
+    {
+        next = 0;
+    }
+
+    D64_IMAGE *image = channels->d64.image;
+    d64_close(image);
+    if (!d64_open(image, disk_swap_file(next)))
+    {
+        wrn("Failed to swap disk");
+        next = disk_swap.current;
+        if (!d64_open(image, disk_swap_file(next)))
+        {
+            err("Failed to reopen %s", disk_swap_file(next));
+            kff_swap_enabled = false;
+            return;
+        }
+    }
+
+    disk_swap.current = next;
+    disk_init_all_channels(image, channels);
+    log("Disk %u: %s", next + 1, disk_swap_file(next));
+}
+
 static u8 disk_handle_load(DISK_CHANNEL *channel)
 {
+    KFF_LOAD_PAGES = 0xff;  // Everything is ready unless streamed
+
     u8 cmd;
     if (channel->filename[0] == '$')    // directory
     {
@@ -663,6 +838,92 @@ static u8 disk_handle_load(DISK_CHANNEL *channel)
     return cmd;
 }
 
+// PRG data being compared with C64 RAM
+static const u8 *disk_verify_buf;
+static u32 disk_verify_addr;
+static u32 disk_verify_end;
+static u32 disk_verify_mismatch;
+
+/******************************************************************************
+* C64 bus DMA callback (compare C64 RAM with buffer)
+******************************************************************************/
+FORCE_INLINE void disk_verify_dma_bus_handler(void)
+{
+    // The verify code has set $01 to $34 to make all RAM visible
+    C64_CRT_CONTROL(CRT_PORT_NONE);
+    C64_ADDR_WRITE(disk_verify_addr);
+
+    C64_DMA_DATA_READ();
+    if ((u8)data != *disk_verify_buf++ && disk_verify_mismatch > 0xffff)
+    {
+        disk_verify_mismatch = disk_verify_addr;
+    }
+
+    if (++disk_verify_addr == disk_verify_end)
+    {
+        C64_INTERFACE_DISABLE();
+    }
+}
+
+C64_DMA_BUS_HANDLER(disk_verify)
+
+// Compare the loaded PRG with C64 RAM. The C64 waits in Ultimax mode while
+// RAM is read using DMA, so RAM under the ROMs and I/O area is compared
+static u8 disk_handle_verify(void)
+{
+    // Start address and size of the PRG data as used by the C64
+    u16 addr = c64_receive_byte();
+    addr |= c64_receive_byte() << 8;
+    u16 size = c64_receive_byte();
+    size |= c64_receive_byte() << 8;
+
+    disk_verify_buf = KFF_BUF + 4;
+    disk_verify_addr = addr;
+    disk_verify_end = addr + size;
+    if (disk_verify_end > 0x10000)
+    {
+        disk_verify_end = 0x10000;
+    }
+    disk_verify_mismatch = 0x10000;
+
+    if (disk_verify_addr < disk_verify_end)
+    {
+        u32 c64_handler = C64_HANDLER;
+        C64_INSTALL_HANDLER(disk_verify_dma_handler);
+        C64_DMA_HANDLER_ENABLE();
+        C64_CRT_CONTROL(C64_DMA_LOW);
+
+        timer_start_ms(500);
+        while (c64_interface_active())
+        {
+            if (timer_elapsed())
+            {
+                C64_INTERFACE_DISABLE();
+                break;
+            }
+        }
+
+        C64_INSTALL_HANDLER(c64_handler);
+        C64_CRT_CONTROL(STATUS_LED_ON|CRT_PORT_ULTIMAX);
+        c64_interface_enable_no_config();
+        C64_CRT_CONTROL(C64_DMA_HIGH);
+
+        if (disk_verify_addr != disk_verify_end)
+        {
+            wrn("Failed to read C64 RAM");
+            return CMD_VERIFY_ERROR;
+        }
+    }
+
+    if (disk_verify_mismatch <= 0xffff)
+    {
+        dbg("Verify error at $%x", disk_verify_mismatch);
+        return CMD_VERIFY_ERROR;
+    }
+
+    return CMD_NONE;
+}
+
 static u8 disk_save_file(DISK_CHANNEL *channel, PARSED_FILENAME *parsed,
                          D64_DIR_ENTRY *existing)
 {
@@ -730,6 +991,10 @@ static u32 disk_write_status(DISK_CHANNEL *channel, u8 status, u8 track, u8 sect
             status_text = "FILES SCRATCHED";
             break;
 
+        case DISK_STATUS_WRITE_PROTECT:
+            status_text = "WRITE PROTECT ON";
+            break;
+
         case DISK_STATUS_NOT_FOUND:
             status_text = "FILE NOT FOUND";
             break;
@@ -738,6 +1003,14 @@ static u32 disk_write_status(DISK_CHANNEL *channel, u8 status, u8 track, u8 sect
             status_text = "FILE EXISTS";
             break;
 
+        case DISK_STATUS_ILLEGAL_TS:
+            status_text = "ILLEGAL TRACK OR SECTOR";
+            break;
+
+        case DISK_STATUS_DISK_FULL:
+            status_text = "DISK FULL";
+            break;
+
         case DISK_STATUS_INIT:
             status_text = "KUNG FU FLASH V" KFF_VER;
             break;
@@ -788,6 +1061,257 @@ static u8 disk_parse_number(char **ptr, u8 max_digits)
     return result;
 }
 
+// RAM of the 1541 for the memory commands ($0000-$07ff)
+static u8 disk_ram[0x800];
+
+static u8 disk_memory_read(u16 addr)
+{
+    // The drive ROM is not available
+    return addr < sizeof(disk_ram) ? disk_ram[addr] : 0x00;
+}
+
+static void disk_memory_write(u16 addr, u8 data)
+{
+    if (addr < sizeof(disk_ram))
+    {
+        disk_ram[addr] = data;
+    }
+}
+
+// Memory commands use binary arguments: address (low, high) and length
+static void disk_handle_memory_read(DISK_CHANNEL *channel, const u8 *cmd)
+{
+    u16 addr = cmd[3] | (cmd[4] << 8);
+    u8 len = cmd[5] ? cmd[5] : 1;
+
+    for (u32 i=0; i<len; i++)
+    {
+        channel->buf[i] = disk_memory_read(addr + i);
+    }
+
+    // The data is read from the command channel instead of the status
+    channel->buf_len = len;
+    channel->buf_ptr = 0;
+    channel->buf2_ptr = 0;
+}
+
+static void disk_handle_memory_write(DISK_CHANNEL *channel, const u8 *cmd)
+{
+    u16 addr = cmd[3] | (cmd[4] << 8);
+    u8 len = cmd[5];
+
+    // Only write the data actually received
+    u8 received = channel->buf2_ptr > 6 ? channel->buf2_ptr - 6 : 0;
+    if (len > received)
+    {
+        len = received;
+    }
+
+    for (u32 i=0; i<len; i++)
+    {
+        disk_memory_write(addr + i, cmd[6 + i]);
+    }
+}
+
+// Skip drive number and colon. Returns false if not drive 0
+static bool disk_skip_drive(char **filename)
+{
+    char *ptr = *filename;
+    while (*ptr)
+    {
+        if (ptr[1] == ':')
+        {
+            // Check drive number
+            if (ptr[0] >= '1' && ptr[0] <= '9')
+            {
+                return false;
+            }
+
+            *filename = ptr + 2;
+            break;
+        }
+
+        ptr++;
+    }
+
+    return true;
+}
+
+// Split "new=old" and return old
+static char * disk_split_names(char *filename)
+{
+    while (*filename)
+    {
+        if (*filename == '=')
+        {
+            *filename++ = 0;
+            break;
+        }
+
+        filename++;
+    }
+
+    if (filename[0] && filename[1] == ':')
+    {
+        filename += 2;  // Drive number is ignored
+    }
+
+    return filename;
+}
+
+// Scratch all matching files in a single pass of the directory
+static u8 disk_scratch_files(DISK_CHANNEL *channel, const char *filename)
+{
+    u8 files = 0;
+    disk_rewind_dir(channel);
+
+    D64_DIR_ENTRY *entry;
+    while ((entry = disk_read_dir(channel)))
+    {
+        if (disk_filename_match(entry, filename) &&
+            disk_delete_file(channel, entry))
+        {
+            files++;
+        }
+    }
+
+    return files;
+}
+
+static u8 disk_rename(DISK_CHANNEL *channel, char *filename)
+{
+    char *old_filename = disk_split_names(filename);
+    if (disk_find_file(channel, filename, 0))
+    {
+        return DISK_STATUS_EXISTS;
+    }
+
+    D64_DIR_ENTRY *entry = disk_find_file(channel, old_filename, 0);
+    if (!entry)
+    {
+        return DISK_STATUS_NOT_FOUND;
+    }
+
+    disk_rename_file(channel, entry, filename);
+    return DISK_STATUS_OK;
+}
+
+// Used for reading the source files when copying
+static DISK_CHANNEL disk_copy_channel;
+
+// Copy (or concatenate) files without transferring them to the C64
+static u8 disk_copy(DISK_CHANNEL *channel, char *filename)
+{
+    DISK_CHANNEL *src = &disk_copy_channel;
+    d64_init(channel->d64.image, &src->d64);
+
+    char *src_filename = disk_split_names(filename);
+    if (!*filename || !*src_filename)
+    {
+        return DISK_STATUS_NOT_FOUND;
+    }
+
+    if (disk_find_file(src, filename, 0))
+    {
+        return DISK_STATUS_EXISTS;
+    }
+
+    u8 status = DISK_STATUS_OK;
+    bool created = false;
+    while (*src_filename)
+    {
+        char *next = src_filename;
+        while (*next && *next != ',')
+        {
+            next++;
+        }
+        if (*next)
+        {
+            *next++ = 0;
+        }
+
+        D64_DIR_ENTRY *entry = disk_find_file(src, src_filename, 0);
+        if (!entry || (entry->type & 7) == D64_FILE_DIR)
+        {
+            status = DISK_STATUS_NOT_FOUND;
+            break;
+        }
+
+        if (!created)
+        {
+            u8 file_type = entry->type & 7;
+            if (!disk_create_file(channel, filename, file_type, NULL))
+            {
+                status = DISK_STATUS_EXISTS;
+                break;
+            }
+            created = true;
+        }
+
+        disk_open_file_read(src, entry);
+
+        size_t len;
+        while ((len = disk_read_data(src, (u8 *)scratch_buf, sizeof(scratch_buf))))
+        {
+            if (disk_write_data(channel, (u8 *)scratch_buf, len) != len)
+            {
+                status = DISK_STATUS_DISK_FULL;
+                break;
+            }
+        }
+
+        if (!cfg_file.img.mode)
+        {
+            file_close(&src->file);
+        }
+
+        if (status != DISK_STATUS_OK)
+        {
+            break;
+        }
+        src_filename = next;
+    }
+
+    if (created)
+    {
+        disk_write_finalize(channel);
+    }
+
+    return status;
+}
+
+// Reformat the mounted image or create a new image in the current directory
+static u8 disk_format(DISK_CHANNEL *channel, char *filename)
+{
+    char *id = NULL;
+    for (char *ptr = filename; *ptr; ptr++)
+    {
+        if (*ptr == ',')
+        {
+            *ptr = 0;
+            id = ptr + 1;
+            break;
+        }
+    }
+
+    if (!*filename)
+    {
+        return DISK_STATUS_NOT_FOUND;
+    }
+
+    if (!cfg_file.img.mode)
+    {
+        return fs_create_image(channel, filename, id);
+    }
+
+    if (!d64_format(channel->d64.image, filename, id))
+    {
+        return DISK_STATUS_WRITE_PROTECT;
+    }
+
+    return DISK_STATUS_OK;
+}
+
 static bool disk_handle_command(DISK_CHANNEL *channel, char *filename)
 {
     u8 status = DISK_STATUS_OK;
@@ -805,49 +1329,80 @@ static bool disk_handle_command(DISK_CHANNEL *channel, char *filename)
 
     if (filename[0] == 'M') // Memory command
     {
-        status = DISK_STATUS_UNSUPPORTED;
+        if (filename[1] == '-' && filename[2] == 'R')
+        {
+            disk_handle_memory_read(channel, (u8 *)filename);
+            disk_last_error = DISK_STATUS_OK;
+            return true;
+        }
+        else if (filename[1] == '-' && filename[2] == 'W')
+        {
+            disk_handle_memory_write(channel, (u8 *)filename);
+        }
+        else
+        {
+            // Drive code cannot be executed (M-E)
+            status = DISK_STATUS_UNSUPPORTED;
+        }
     }
     else if (filename[0] == 'S')    // Scratch command
     {
-        // Scan for drive number and start of filename
-        while (*filename)
+        if (!disk_skip_drive(&filename))
         {
-            if (filename[1] == ':')
-            {
-                // Check drive number
-                if (filename[0] >= '1' && filename[0] <= '9')
-                {
-                    return false;
-                }
+            return false;
+        }
 
-                filename += 2;
-                break;
-            }
+        c64_send_command(CMD_WAIT_SYNC);
+        c64_interface(false);
+        disk_receive_data(channel->buf);   // Save temp data
 
-            filename++;
+        track = disk_scratch_files(channel, filename);
+
+        disk_send_data(channel->buf);  // Send temp data back
+        c64_interface_sync();
+
+        status = DISK_STATUS_SCRATCHED;
+    }
+    else if ((filename[0] == 'C' && filename[1] != 'D') ||  // Copy command
+             filename[0] == 'R')                            // Rename command
+    {
+        bool copy = filename[0] == 'C';
+        if (!disk_skip_drive(&filename))
+        {
+            return false;
         }
 
         c64_send_command(CMD_WAIT_SYNC);
         c64_interface(false);
         disk_receive_data(channel->buf);   // Save temp data
 
-        disk_rewind_dir(channel);
-
-        D64_DIR_ENTRY *entry;
-        while ((entry = disk_read_dir(channel)))
+        if (copy)
         {
-            if (disk_filename_match(entry, filename) &&
-                disk_delete_file(channel, entry))
-            {
-                disk_rewind_dir(channel);
-                track++;
-            }
+            status = disk_copy(channel, filename);
+        }
+        else
+        {
+            status = disk_rename(channel, filename);
         }
 
         disk_send_data(channel->buf);  // Send temp data back
         c64_interface_sync();
+    }
+    else if (filename[0] == 'N')    // New (format) command
+    {
+        if (!disk_skip_drive(&filename))
+        {
+            return false;
+        }
 
-        status = DISK_STATUS_SCRATCHED;
+        c64_send_command(CMD_WAIT_SYNC);
+        c64_interface(false);
+        disk_receive_data(channel->buf);   // Save temp data
+
+        status = disk_format(channel, filename);
+
+        disk_send_data(channel->buf);  // Send temp data back
+        c64_interface_sync();
     }
     else if (filename[0] == 'C' && filename[1] == 'D')  // Directory command
     {
@@ -906,9 +1461,10 @@ static bool disk_handle_command(DISK_CHANNEL *channel, char *filename)
             buf_channel->buf_mode == DISK_BUF_USE && track)
         {
             D64_TS ts = {track, sector};
+            u8 *buf = disk_channel_buf(buf_channel);
             if (read)
             {
-                d64_read_sector(&buf_channel->d64, buf_channel->buf, ts);
+                d64_read_sector(&buf_channel->d64, buf, ts);
                 buf_channel->buf_ptr = 0;
             }
             else
@@ -917,11 +1473,70 @@ static bool disk_handle_command(DISK_CHANNEL *channel, char *filename)
                 c64_interface(false);
                 disk_receive_data(channel->buf);    // Save temp data
 
-                d64_write_sector(&buf_channel->d64, buf_channel->buf, ts);
+                d64_write_sector(&buf_channel->d64, buf, ts);
+
+                disk_send_data(channel->buf);   // Send temp data back
+                c64_interface_sync();
+            }
+        }
+        else
+        {
+            status = DISK_STATUS_NOT_FOUND;
+        }
+    }
+    else if (filename[0] == 'U' &&
+             (filename[1] == 'R' ||     // KFF multi-block read
+              filename[1] == 'W'))      // KFF multi-block write
+    {
+        bool read = filename[1] == 'R';
+        filename += 2;
+
+        u8 channel_no = disk_parse_number(&filename, 2);
+        u8 drive = disk_parse_number(&filename, 1);
+        track = disk_parse_number(&filename, 2);
+        sector = disk_parse_number(&filename, 2);
+        u8 count = disk_parse_number(&filename, 2);
+
+        if (drive)
+        {
+            return false;
+        }
+
+        DISK_CHANNEL *buf_channel = channel - (15 - channel_no);
+        if (cfg_file.img.mode && channel_no >= 2 && channel_no <= 14 &&
+            buf_channel == disk_block_channel && track && count &&
+            count <= DISK_BLOCK_BUF_SIZE / D64_SECTOR_LEN)
+        {
+            D64_TS ts = {track, sector};
+            bool result;
+            if (read)
+            {
+                result = d64_read_sectors(&buf_channel->d64, DISK_BLOCK_BUF,
+                                          ts, count);
+                if (result)
+                {
+                    buf_channel->buf_len = count * D64_SECTOR_LEN;
+                }
+            }
+            else
+            {
+                c64_send_command(CMD_WAIT_SYNC);
+                c64_interface(false);
+                disk_receive_data(channel->buf);    // Save temp data
+
+                // Only a single sync for all the blocks
+                result = d64_write_sectors(&buf_channel->d64, DISK_BLOCK_BUF,
+                                           ts, count);
 
                 disk_send_data(channel->buf);   // Send temp data back
                 c64_interface_sync();
             }
+            buf_channel->buf_ptr = 0;
+
+            if (!result)
+            {
+                status = DISK_STATUS_ILLEGAL_TS;
+            }
         }
         else
         {
@@ -1064,6 +1679,20 @@ static u8 disk_handle_open_prg(DISK_CHANNEL *channel, char *filename)
 
 static u8 disk_hand_open_buffer(DISK_CHANNEL *channel)
 {
+    if (channel->filename[1] == 'T')    // KFF multi-block buffer
+    {
+        if (disk_block_channel && disk_block_channel != channel)
+        {
+            disk_close_channel(disk_block_channel);
+        }
+
+        disk_block_channel = channel;
+        channel->buf_len = DISK_BLOCK_BUF_SIZE;
+        channel->buf_ptr = 0;
+        channel->buf_mode = DISK_BUF_USE;
+        return CMD_NONE;
+    }
+
     channel->buf_len = sizeof(channel->buf);
     channel->buf_ptr = 1;   // Skip first byte like the 1541
     channel->buf_mode = DISK_BUF_USE;
@@ -1164,8 +1793,9 @@ static u8 disk_handle_unlisten(DISK_CHANNEL *channel)
         return CMD_NONE;
     }
 
-    // Null terminate "filename"
-    if (channel->buf2[channel->buf2_ptr - 1] == (u8)'\r')
+    // Null terminate "filename". Memory commands may end with a binary CR
+    bool memory_cmd = channel->buf2[0] == 'M' && channel->buf2[1] == '-';
+    if (!memory_cmd && channel->buf2[channel->buf2_ptr - 1] == (u8)'\r')
     {
         channel->buf2[--channel->buf2_ptr] = 0;
     }
@@ -1199,8 +1829,8 @@ static u8 disk_handle_receive_byte(DISK_CHANNEL *channel)
         return CMD_DISK_ERROR;
     }
 
-    channel->buf[channel->buf_ptr++] = data;
-    if (channel->buf_ptr >= sizeof(channel->buf))   // Check if buffer is full
+    disk_channel_buf(channel)[channel->buf_ptr++] = data;
+    if (channel->buf_ptr >= disk_channel_buf_size(channel)) // Check if buffer is full
     {
         channel->buf_ptr = 0;
 
@@ -1228,20 +1858,30 @@ static DISK_CHANNEL * disk_receive_channel(DISK_CHANNEL *channels)
     return channels + channel;
 }
 
-static void disk_receive_filename(char *filename)
+// Returns the number of bytes received
+static u8 disk_receive_filename(char *filename)
 {
     u8 size = c64_receive_byte();
 
-    while (size--)
+    for (u8 i=0; i<size; i++)
+    {
+        filename[i] = c64_receive_byte();
+    }
+    filename[size] = 0;
+
+    // Memory commands contain binary data that must be kept as is
+    if (filename[0] != 'M' || filename[1] != '-')
     {
-        u8 c = c64_receive_byte();
-        if (c == 0xff)
+        for (u8 i=0; i<size; i++)
         {
-            c = '~';
+            if (filename[i] == (char)0xff)
+            {
+                filename[i] = '~';
+            }
         }
-        *filename++ = c;
     }
-    *filename = 0;
+
+    return size;
 }
 
 static u8 disk_send_command(u8 cmd, DISK_CHANNEL*channels)
@@ -1264,6 +1904,17 @@ static u8 disk_send_command(u8 cmd, DISK_CHANNEL*channels)
     u8 reply;
     while (!c64_get_reply(cmd, &reply))
     {
+        if (kff_swap_pressed)
+        {
+            kff_swap_pressed = false;
+            if (cfg_file.img.mode == DISK_MODE_D64)
+            {
+                disk_swap_next(channels);
+            }
+        }
+
+        disk_load_poll();
+        log_poll();
         if (timer_elapsed())
         {
             if (disk_last_error > DISK_STATUS_SCRATCHED &&
@@ -1278,10 +1929,14 @@ static u8 disk_send_command(u8 cmd, DISK_CHANNEL*channels)
         }
     }
 
+    // The C64 will not reply during LOAD unless it was aborted
+    disk_load_channel = NULL;
     return reply;
 }
 
-static void disk_loop(void)
+// Use CMD_MOUNT_DISK as the first command to start BASIC. The BASIC commands
+// to run are placed in KFF_BUF
+static void disk_loop(u8 cmd)
 {
     D64_IMAGE *image = &d64_state.image;    // Reuse memory from menu
     DISK_CHANNEL*channels = (DISK_CHANNEL *)(crt_ram_buf + 0x200);
@@ -1290,9 +1945,12 @@ static void disk_loop(void)
     disk_init_all_channels(image, channels);
 
     disk_last_error = DISK_STATUS_INIT;
+    kff_freeze_enabled = true;
+    kff_swap_enabled = disk_swap.count > 1;
+    kff_swap_pressed = false;
+    fs_dir_cache_invalidate();
+    memset(disk_ram, 0, sizeof(disk_ram));
 
-    // BASIC commands to run are placed in KFF_BUF
-    u8 cmd = CMD_MOUNT_DISK;
     while (true)
     {
         u8 reply = disk_send_command(cmd, channels);
@@ -1321,7 +1979,8 @@ static void disk_loop(void)
 
             case REPLY_OPEN:
                 channel = disk_receive_channel(channels);
-                disk_receive_filename(channel->filename);
+                // Memory commands on channel 15 may contain binary data
+                channel->buf2_ptr = disk_receive_filename(channel->filename);
                 dbg("Got OPEN command for channel %u for: %s",
                     channel->number, channel->filename);
                 cmd = disk_handle_open(channel);
@@ -1358,6 +2017,15 @@ static void disk_loop(void)
                 cmd = disk_handle_receive_byte(listen);
                 break;
 
+            case REPLY_VERIFY:
+                cmd = disk_handle_verify();
+                break;
+
+            case REPLY_SNAPSHOT:
+                cmd = snapshot_save();
+                fs_dir_cache_invalidate();
+                break;
+
             default:
                 wrn("Got unknown disk reply: %x", reply);
                 break;
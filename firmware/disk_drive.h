@@ -23,14 +23,23 @@ static const u16 dir_link_addr = 0x0101;
 
 static u8 disk_last_error;
 
+// Buffer for multi-block commands at the end of the LZ4 window (not used in
+// disk mode). The rest of the LZ4 window is used for the directory cache and
+// the filename index
+#define DISK_BLOCK_BUF_SIZE (64*256)
+#define DISK_BLOCK_BUF      (lz4_window + sizeof(lz4_window) - DISK_BLOCK_BUF_SIZE)
+
 typedef enum
 {
-    DISK_STATUS_OK          = 00,
-    DISK_STATUS_SCRATCHED   = 01,
-    DISK_STATUS_NOT_FOUND   = 62,
-    DISK_STATUS_EXISTS      = 63,
-    DISK_STATUS_INIT        = 73,
-    DISK_STATUS_UNSUPPORTED = 0xFF
+    DISK_STATUS_OK            = 00,
+    DISK_STATUS_SCRATCHED     = 01,
+    DISK_STATUS_WRITE_PROTECT = 26,
+    DISK_STATUS_NOT_FOUND     = 62,
+    DISK_STATUS_EXISTS        = 63,
+    DISK_STATUS_ILLEGAL_TS    = 66,
+    DISK_STATUS_DISK_FULL     = 72,
+    DISK_STATUS_INIT          = 73,
+    DISK_STATUS_UNSUPPORTED   = 0xFF
 } DISK_STATUS;
 
 typedef struct
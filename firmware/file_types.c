@@ -76,6 +76,37 @@ static u8 get_filename_length(const char *filename, u8 *extension)
     return length;
 }
 
+static bool is_lz4_file(char *filename)
+{
+    u8 extension;
+    u8 length = get_filename_length(filename, &extension);
+
+    return length - extension == 4 &&
+           compare_extension(filename + extension + 1, "LZ4");
+}
+
+// Compressed files must have a 3 letter extension before .lz4 (e.g. x.crt.lz4)
+static u8 get_lz4_file_type(char *filename, u8 extension)
+{
+    if (extension < 5 || filename[extension - 4] != '.')
+    {
+        return FILE_UNKNOWN;
+    }
+
+    filename += extension - 3;
+    if (compare_extension(filename, "CRT"))
+    {
+        return FILE_CRT;
+    }
+
+    if (compare_extension(filename, "PRG"))
+    {
+        return FILE_PRG;
+    }
+
+    return FILE_UNKNOWN;
+}
+
 static u8 get_file_type(FILINFO *info)
 {
     if (info->fattrib & AM_DIR)
@@ -150,6 +181,30 @@ static u8 get_file_type(FILINFO *info)
         {
             return FILE_TXT;
         }
+        else if (compare_extension(filename, "KFS"))
+        {
+            if (info->fsize == sizeof(KFS_HEADER) + KFS_RAM_SIZE)
+            {
+                return FILE_KFS;
+            }
+        }
+        else if (compare_extension(filename, "REU"))
+        {
+            if (info->fsize && info->fsize <= sizeof(crt_buf) &&
+                !(info->fsize & 0xffff))
+            {
+                return FILE_REU;
+            }
+        }
+        else if (compare_extension(filename, "LST") ||
+                 compare_extension(filename, "M3U"))
+        {
+            return FILE_LST;
+        }
+        else if (compare_extension(filename, "LZ4"))
+        {
+            return get_lz4_file_type(info->fname, extension);
+        }
         else if (compare_extension(filename, "UPD"))
         {
             if (info->fsize == UPD_FILE_SIZE)
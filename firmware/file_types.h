@@ -165,6 +165,9 @@ typedef enum
     FILE_T64_PRG,
     FILE_ROM,
     FILE_TXT,
+    FILE_KFS,
+    FILE_REU,
+    FILE_LST,
 
     FILE_UPD        = 0xfe,
     FILE_UNKNOWN
@@ -174,6 +177,8 @@ typedef enum
 {
     CFG_FLAG_NO_PERSIST         = 0x01,
     CFG_FLAG_REU_DISABLED       = 0x02,
+    CFG_FLAG_REU_SIZE_1         = 0x04,
+    CFG_FLAG_REU_SIZE_2         = 0x08,
 
     CFG_FLAG_AUTOSTART_D64      = 0x10,
     CFG_FLAG_DEVICE_NUM_D64_1   = 0x20,
@@ -184,6 +189,10 @@ typedef enum
 #define CFG_FLAG_DEVICE_D64_POS 0x05
 #define CFG_FLAG_DEVICE_D64_MSK (0x07 << CFG_FLAG_DEVICE_D64_POS)
 
+// REU size is 1MB shifted right by this field (0 = 1MB, 3 = 128k)
+#define CFG_FLAG_REU_SIZE_POS 0x02
+#define CFG_FLAG_REU_SIZE_MSK (0x03 << CFG_FLAG_REU_SIZE_POS)
+
 typedef enum
 {
     CFG_NONE = 0x00,
@@ -195,7 +204,8 @@ typedef enum
     CFG_BASIC,
     CFG_KILL,
     CFG_BASIC_C128,
-    CFG_DIAG
+    CFG_DIAG,
+    CFG_SNAPSHOT
 } CFG_BOOT_TYPE;
 
 typedef enum
@@ -217,7 +227,8 @@ typedef enum
     PRG_MODE_PRG    = 0x00,
     PRG_MODE_P00    = 0x01,
     PRG_MODE_D64    = 0x02,
-    PRG_MODE_T64    = 0x03
+    PRG_MODE_T64    = 0x03,
+    PRG_MODE_USB    = 0x04  // PRG pushed from USB (not persisted)
 } CFG_PRG_MODE;
 
 #pragma pack(push)
@@ -262,4 +273,34 @@ typedef struct
 #define UPD_FILE_SIZE   (128*1024)
 #define UPD_FILE_VER    (112*1024)
 
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    u8 a;
+    u8 x;
+    u8 y;
+    u8 sp;
+    u8 cpu_ddr;         // $00
+    u8 cpu_port;        // $01
+    u8 vic[0x2f];       // $d000-$d02e
+    u8 cia[8];          // $dc00/$dd00-$dc03/$dd03 interleaved
+    u8 color[1024];     // $d800/$d900/$da00/$db00 interleaved
+} KFS_STATE;
+
+typedef struct
+{
+    u8 signature[4];    // KFS_SIGNATURE
+    u8 flags;           // CFG_FLAGS
+    CFG_IMG_HEADER img; // Mounted disk
+    char path[750];
+    char file[256];
+    u8 kff_ram[256];    // $de00-$deff
+    KFS_STATE state;
+} KFS_HEADER;           // Followed by 64K of C64 RAM
+#pragma pack(pop)
+
+#define KFS_SIGNATURE   "KFS\1"
+#define KFS_RAM_SIZE    (64*1024)
+
 static CFG_FILE cfg_file;
@@ -121,6 +121,18 @@ static u32 file_write(FIL *file, void *buffer, size_t bytes)
     return bytes_written;
 }
 
+static bool file_expand(FIL *file, FSIZE_t size)
+{
+    FRESULT res = f_expand(file, size, 1);
+    if (res != FR_OK)
+    {
+        wrn("f_expand failed (%u)", res);
+    }
+
+    led_on();
+    return res == FR_OK;
+}
+
 static bool file_truncate(FIL *file)
 {
     FRESULT res = f_truncate(file);
@@ -181,6 +193,18 @@ static bool file_delete(const char *file_name)
     return res == FR_OK;
 }
 
+static bool file_rename(const char *old_name, const char *new_name)
+{
+    FRESULT res = f_rename(old_name, new_name);
+    if (res != FR_OK)
+    {
+        err("f_rename '%s' failed (%u)", old_name, res);
+    }
+
+    led_on();
+    return res == FR_OK;
+}
+
 static bool dir_change(const char *path)
 {
     FRESULT res = f_chdir(path);
@@ -18,6 +18,79 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+// The directory listing and filename index are kept in the LZ4 window (not
+// used in disk mode)
+#define FS_NAME_INDEX_SLOTS 8192
+#define FS_NAME_INDEX_MAX   (FS_NAME_INDEX_SLOTS * 3 / 4)
+#define FS_NAME_INDEX_SIZE  (FS_NAME_INDEX_SLOTS * sizeof(u32))
+#define FS_NAME_INDEX_BUF   ((u32 *)(lz4_window + FS_DIR_CACHE_SIZE))
+
+// Each slot holds a fingerprint of the padded filename
+#define FS_NAME_INDEX_USED  0x80000000
+#define FS_NAME_INDEX_DIR   0x40000000
+#define FS_NAME_INDEX_HASH  0x3fffffff
+
+#define FS_DIR_CACHE_BUF    (lz4_window)
+#define FS_DIR_CACHE_SIZE   (sizeof(lz4_window) - DISK_BLOCK_BUF_SIZE - \
+                             FS_NAME_INDEX_SIZE)
+
+typedef struct
+{
+    bool valid;
+    DWORD cluster;      // Start cluster of the directory
+    u16 size;
+    char filter[256];
+} FS_DIR_CACHE;
+
+static FS_DIR_CACHE fs_dir_cache;
+
+// Hash table of the padded filenames in the current directory
+typedef struct
+{
+    bool valid;
+    bool overflow;      // Too many files to index
+    DWORD cluster;      // Start cluster of the directory
+} FS_NAME_INDEX;
+
+static FS_NAME_INDEX fs_name_index;
+
+// Must be called when the file system is changed
+static inline void fs_dir_cache_invalidate(void)
+{
+    fs_dir_cache.valid = false;
+    fs_name_index.valid = false;
+}
+
+static bool fs_dir_cache_get(DISK_CHANNEL *channel, u8 **ptr)
+{
+    if (!fs_dir_cache.valid || fs_dir_cache.cluster != fs.cdir ||
+        strcmp(fs_dir_cache.filter, channel->filename_dir) != 0)
+    {
+        return false;
+    }
+
+    memcpy(*ptr, FS_DIR_CACHE_BUF, fs_dir_cache.size);
+    *ptr += fs_dir_cache.size;
+    return true;
+}
+
+static void fs_dir_cache_put(DISK_CHANNEL *channel, u8 *start, u8 *end)
+{
+    u32 size = end - start;
+    if (size > FS_DIR_CACHE_SIZE ||
+        strlen(channel->filename_dir) >= sizeof(fs_dir_cache.filter))
+    {
+        fs_dir_cache.valid = false;
+        return;
+    }
+
+    memcpy(FS_DIR_CACHE_BUF, start, size);
+    strcpy(fs_dir_cache.filter, channel->filename_dir);
+    fs_dir_cache.cluster = fs.cdir;
+    fs_dir_cache.size = size;
+    fs_dir_cache.valid = true;
+}
+
 static void fs_format_diskname(char *buf, const char *filename)
 {
     for (int i=0; i<16; i++)
@@ -117,6 +190,109 @@ static D64_DIR_ENTRY * fs_read_dir(DISK_CHANNEL *channel)
     return entry;
 }
 
+static u32 fs_name_index_hash(const char *name)
+{
+    // FNV-1a hash
+    u32 hash = 2166136261u;
+    for (u8 i=0; i<16; i++)
+    {
+        hash = (hash ^ (u8)name[i]) * 16777619u;
+    }
+
+    return hash & FS_NAME_INDEX_HASH;
+}
+
+static u16 fs_name_index_slot(u32 hash)
+{
+    // Linear probing. There is always an empty slot
+    u16 slot = hash & (FS_NAME_INDEX_SLOTS - 1);
+    while ((FS_NAME_INDEX_BUF[slot] & FS_NAME_INDEX_USED) &&
+           (FS_NAME_INDEX_BUF[slot] & FS_NAME_INDEX_HASH) != hash)
+    {
+        slot = (slot + 1) & (FS_NAME_INDEX_SLOTS - 1);
+    }
+
+    return slot;
+}
+
+static void fs_name_index_build(DISK_CHANNEL *channel)
+{
+    memset(FS_NAME_INDEX_BUF, 0, FS_NAME_INDEX_SIZE);
+    fs_name_index.cluster = fs.cdir;
+    fs_name_index.overflow = false;
+    fs_name_index.valid = true;
+
+    fs_rewind_dir(channel);
+
+    u16 files = 0;
+    D64_DIR_ENTRY *entry;
+    while ((entry = fs_read_dir(channel)))
+    {
+        if (++files > FS_NAME_INDEX_MAX)
+        {
+            fs_name_index.overflow = true;
+            break;
+        }
+
+        // Keep the first file if the name is used twice (as a scan would)
+        u32 hash = fs_name_index_hash(entry->filename);
+        u16 slot = fs_name_index_slot(hash);
+        if (!FS_NAME_INDEX_BUF[slot])
+        {
+            FS_NAME_INDEX_BUF[slot] = FS_NAME_INDEX_USED | hash;
+            if ((entry->type & 7) == D64_FILE_DIR)
+            {
+                FS_NAME_INDEX_BUF[slot] |= FS_NAME_INDEX_DIR;
+            }
+        }
+    }
+}
+
+// Look up a filename without wildcards. Returns false if the directory must
+// be scanned instead. Only a 30-bit fingerprint of the name is stored, so a
+// missing file could match (very unlikely). It will then fail to open
+static bool fs_find_file(DISK_CHANNEL *channel, const char *filename,
+                         D64_DIR_ENTRY **entry)
+{
+    if (!fs_name_index.valid || fs_name_index.cluster != fs.cdir)
+    {
+        fs_name_index_build(channel);
+    }
+
+    if (fs_name_index.overflow)
+    {
+        return false;
+    }
+
+    *entry = NULL;
+
+    char name[16];
+    d64_pad_filename(name, filename);
+    u16 slot = fs_name_index_slot(fs_name_index_hash(name));
+    if (!FS_NAME_INDEX_BUF[slot])
+    {
+        return true;
+    }
+
+    // Reuse memory from D64
+    D64_DIR_ENTRY *found = &channel->d64.dir.entries[0];
+    if (FS_NAME_INDEX_BUF[slot] & FS_NAME_INDEX_DIR)
+    {
+        found->type = D64_FILE_DIR | D64_FILE_NO_SPLAT;
+    }
+    else
+    {
+        found->type = D64_FILE_PRG | D64_FILE_NO_SPLAT;
+    }
+
+    found->blocks = 0;
+    memcpy(found->filename, name, 16);
+    found->ignored[0] = 0;  // null terminate filename
+
+    *entry = found;
+    return true;
+}
+
 static u16 fs_get_blocks_free(void)
 {
     u32 blocks = filesystem_getfree() * 2;
@@ -156,6 +332,11 @@ static inline size_t fs_read_data(DISK_CHANNEL *channel, u8 *buf, size_t buf_siz
     return file_read(&channel->file, buf, buf_size);
 }
 
+static inline FSIZE_t fs_get_size(DISK_CHANNEL *channel)
+{
+    return f_size(&channel->file);
+}
+
 static inline bool fs_bytes_left(DISK_CHANNEL *channel)
 {
     return !f_eof(&channel->file);
@@ -171,12 +352,14 @@ static bool fs_create_file(DISK_CHANNEL *channel, const char *filename,
         filename = fs_get_filename(existing_file);
     }
 
+    fs_dir_cache_invalidate();
     return file_open(&channel->file, filename, mode);
 }
 
 static size_t fs_write_data(DISK_CHANNEL *channel, u8 *buf,
                             size_t buf_size)
 {
+    fs_dir_cache_invalidate();
     size_t result = file_write(&channel->file, buf, buf_size);
     if (!file_sync(&channel->file))
     {
@@ -188,19 +371,97 @@ static size_t fs_write_data(DISK_CHANNEL *channel, u8 *buf,
 
 static inline bool fs_write_finalize(DISK_CHANNEL *channel)
 {
+    fs_dir_cache_invalidate();
     return file_close(&channel->file);
 }
 
 static bool fs_delete_file(DISK_CHANNEL *channel, D64_DIR_ENTRY *entry)
 {
     char *filename = fs_get_filename(entry);
+    fs_dir_cache_invalidate();
     return file_delete(filename);
 }
 
+static bool fs_rename_file(DISK_CHANNEL *channel, D64_DIR_ENTRY *entry,
+                           const char *filename)
+{
+    char *old_filename = fs_get_filename(entry);
+    fs_dir_cache_invalidate();
+    return file_rename(old_filename, filename);
+}
+
+// Create a blank D64, D71 or D81 depending on the extension (default D64)
+static u8 fs_create_image(DISK_CHANNEL *channel, const char *filename,
+                          const char *id)
+{
+    u8 extension;
+    u8 length = get_filename_length(filename, &extension);
+
+    u8 type = D64_TYPE_UNKNOWN;
+    if (length - extension == 4)
+    {
+        char *ext = (char *)filename + extension + 1;
+        if (compare_extension(ext, "D64"))
+        {
+            type = D64_TYPE_D64;
+        }
+        else if (compare_extension(ext, "D71"))
+        {
+            type = D64_TYPE_D71;
+        }
+        else if (compare_extension(ext, "D81"))
+        {
+            type = D64_TYPE_D81;
+        }
+    }
+
+    char diskname[17];
+    char image_filename[FF_LFN_BUF + 1];
+    if (type == D64_TYPE_UNKNOWN)
+    {
+        type = D64_TYPE_D64;
+        extension = length;
+        if (length > FF_LFN_BUF - 4)
+        {
+            return DISK_STATUS_NOT_FOUND;
+        }
+        sprint(image_filename, "%s.D64", filename);
+    }
+    else
+    {
+        strcpy(image_filename, filename);
+    }
+
+    u8 diskname_len = extension < 16 ? extension : 16;
+    memcpy(diskname, filename, diskname_len);
+    diskname[diskname_len] = 0;
+
+    FILINFO file_info;
+    if (file_stat(image_filename, &file_info))
+    {
+        return DISK_STATUS_EXISTS;
+    }
+
+    fs_dir_cache_invalidate();
+    if (!d64_create(channel->d64.image, image_filename, type, diskname, id))
+    {
+        return DISK_STATUS_WRITE_PROTECT;
+    }
+
+    return DISK_STATUS_OK;
+}
+
+// The disk list only applies to its own images
+static inline void fs_leave_disk_list(void)
+{
+    kff_swap_enabled = false;
+}
+
 static bool fs_dir_up(void)
 {
     if (cfg_file.img.mode)
     {
+        fs_leave_disk_list();
         cfg_file.img.mode = DISK_MODE_FS;
         return true;
     }
@@ -212,6 +473,7 @@ static bool fs_dir_change(const char *path)
 {
     if (dir_change(path))
     {
+        fs_leave_disk_list();
         cfg_file.img.mode = DISK_MODE_FS;
         return true;
     }
@@ -253,6 +515,7 @@ static bool fs_change(DISK_CHANNEL *channel, const char *filename)
         return false;
     }
 
+    fs_leave_disk_list();
     cfg_file.img.mode = DISK_MODE_D64;
     return true;
 }
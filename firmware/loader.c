@@ -29,9 +29,42 @@
 #define EAPI_OFFSET 0x3800
 #define EAPI_SIZE   0x300
 
+// Snapshot RAM followed by the header when restoring a snapshot
+#define KFS_RAM_BUF     (crt_buf)
+#define KFS_HEADER_BUF  ((KFS_HEADER *)(crt_buf + KFS_RAM_SIZE))
+
+// Read from a CRT image source. Returns number of bytes read
+typedef u32 (*crt_read_func)(void *source, void *buf, u32 size);
+
+// Size of PRG in dat_buf if pushed from USB
+static u16 usb_push_prg_size;
+
+// Text is sent to the launcher a window at a time
+#define TXT_WINDOW_SIZE (4*1024)
+
+// File offset of each page shown by the text reader
+#define TXT_PAGES       ((u32 *)lz4_window)
+#define TXT_MAX_PAGES   (sizeof(lz4_window) / sizeof(u32))
+
+static FIL txt_file;
+static u16 txt_page_count;
+
 static u16 prg_load_file(FIL *file)
 {
-    u16 len = file_read(file, dat_buf, sizeof(dat_buf));
+    u16 len;
+    if (lz4_open(&lz4_state, file))
+    {
+        len = lz4_read(&lz4_state, dat_buf, sizeof(dat_buf));
+        if (lz4_failed(&lz4_state))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        len = file_read(file, dat_buf, sizeof(dat_buf));
+    }
+
     if (!prg_size_valid(len))
     {
         wrn("Unsupported PRG size: %u", len);
@@ -87,18 +120,110 @@ static void rom_mirror(u16 len)
     }
 }
 
-static u16 txt_load_file(FIL *file)
+static bool reu_load_file(FIL *file, const char *file_name)
 {
-    memset(KFF_BUF, 0x00, sizeof(KFF_BUF));
+    crt_buf_invalidate();
 
-    u16 len = file_read(file, &KFF_BUF[DIR_NAME_LENGTH+2],
-                        sizeof(KFF_BUF) - (DIR_NAME_LENGTH+3));
-    return len;
+    // Preload the REU using a single sequential read
+    u32 size = f_size(file);
+    if (file_read(file, REU_BUF, size) != size)
+    {
+        return false;
+    }
+
+    reu_buf_valid(size);
+    strcpy(reu_buf_header.path, cfg_file.path);
+    strcpy(reu_buf_header.file, file_name);
+    return true;
 }
 
-static bool crt_load_header(FIL *file, CRT_HEADER *header)
+static bool reu_save_file(void)
 {
-    u32 len = file_read(file, header, sizeof(CRT_HEADER));
+    if (!dir_change(reu_buf_header.path))
+    {
+        return false;
+    }
+
+    FIL file;
+    if (!file_open(&file, reu_buf_header.file, FA_WRITE))
+    {
+        return false;
+    }
+
+    u32 size = reu_buf_header.size;
+    bool result = file_write(&file, REU_BUF, size) == size;
+    result &= file_close(&file);
+
+    if (result)
+    {
+        reu_buf_valid(size);
+    }
+
+    return result;
+}
+
+static u32 crt_file_read(void *file, void *buf, u32 size)
+{
+    return file_read((FIL *)file, buf, size);
+}
+
+// Buffered CRT file reading to avoid small unaligned reads from SD card
+typedef struct
+{
+    FIL *file;
+    u8 *buf;
+    u32 size;
+    u32 pos;
+    u32 len;
+} CRT_FILE_BUF;
+
+static void crt_file_buf_init(CRT_FILE_BUF *file_buf, FIL *file, u8 *buf, u32 size)
+{
+    file_buf->file = file;
+    file_buf->buf = buf;
+    file_buf->size = size;
+    file_buf->pos = 0;
+    file_buf->len = 0;
+}
+
+static u32 crt_file_buf_read(void *source, void *buf, u32 size)
+{
+    CRT_FILE_BUF *file_buf = (CRT_FILE_BUF *)source;
+    u8 *buf_ptr = (u8 *)buf;
+    u32 bytes_read = 0;
+
+    while (bytes_read < size)
+    {
+        if (file_buf->pos >= file_buf->len)
+        {
+            // Read up to a sector boundary to keep following reads aligned
+            u32 offset = f_tell(file_buf->file) & (FF_MIN_SS - 1);
+            file_buf->len = file_read(file_buf->file, file_buf->buf,
+                                      file_buf->size - offset);
+            file_buf->pos = 0;
+            if (!file_buf->len)
+            {
+                break;
+            }
+        }
+
+        u32 len = file_buf->len - file_buf->pos;
+        if (len > size - bytes_read)
+        {
+            len = size - bytes_read;
+        }
+
+        memcpy(buf_ptr + bytes_read, file_buf->buf + file_buf->pos, len);
+        file_buf->pos += len;
+        bytes_read += len;
+    }
+
+    return bytes_read;
+}
+
+static bool crt_read_header(crt_read_func read, void *source, CRT_HEADER *header)
+{
+    u32 len = read(source, header, sizeof(CRT_HEADER));
 
     if (len != sizeof(CRT_HEADER))
     {
@@ -146,6 +271,16 @@ static bool crt_load_header(FIL *file, CRT_HEADER *header)
     return true;
 }
 
+static bool crt_load_header(FIL *file, CRT_HEADER *header)
+{
+    if (lz4_open(&lz4_state, file))
+    {
+        return crt_read_header(lz4_read, &lz4_state, header);
+    }
+
+    return crt_read_header(crt_file_read, file, header);
+}
+
 static bool crt_write_header(FIL *file, u16 type, u8 exrom, u8 game, const char *name)
 {
     CRT_HEADER header;
@@ -173,10 +308,8 @@ static bool crt_write_header(FIL *file, u16 type, u8 exrom, u8 game, const char
     return len == sizeof(CRT_HEADER);
 }
 
-static bool crt_load_chip_header(FIL *file, CRT_CHIP_HEADER *header)
+static bool crt_parse_chip_header(CRT_CHIP_HEADER *header, u32 len)
 {
-    u32 len = file_read(file, header, sizeof(CRT_CHIP_HEADER));
-
     if (len != sizeof(CRT_CHIP_HEADER) ||
         memcmp(CRT_CHIP_SIGNATURE, header->signature, sizeof(header->signature)) != 0)
     {
@@ -264,15 +397,21 @@ static s32 crt_get_offset(CRT_CHIP_HEADER *header, u16 cartridge_type)
     return offset;
 }
 
-static u8 crt_load_file(FIL *crt_file, u16 cartridge_type)
+static u8 crt_read_chips(crt_read_func read, void *source, u16 cartridge_type)
 {
     memset(crt_buf, 0xff, sizeof(crt_buf));
     u8 banks_in_use = 0;
 
-    while (!f_eof(crt_file))
+    while (true)
     {
         CRT_CHIP_HEADER header;
-        if (!crt_load_chip_header(crt_file, &header))
+        u32 len = read(source, &header, sizeof(CRT_CHIP_HEADER));
+        if (!len)
+        {
+            break;  // End of CRT image
+        }
+
+        if (!crt_parse_chip_header(&header, len))
         {
             err("Failed to read CRT chip header");
             return 0;
@@ -299,7 +438,7 @@ static u8 crt_load_file(FIL *crt_file, u16 cartridge_type)
         }
 
         u8 *read_buf = crt_buf + offset;
-        if (file_read(crt_file, read_buf, header.image_size) != header.image_size)
+        if (read(source, read_buf, header.image_size) != header.image_size)
         {
             err("Failed to read CRT chip image. Bank %u at $%x",
                 header.bank, header.start_address);
@@ -316,6 +455,21 @@ static u8 crt_load_file(FIL *crt_file, u16 cartridge_type)
     return banks_in_use;
 }
 
+// crt_load_header() must be called first
+static u8 crt_load_file(FIL *crt_file, u16 cartridge_type)
+{
+    if (lz4_is_open(&lz4_state, crt_file))
+    {
+        u8 banks = crt_read_chips(lz4_read, &lz4_state, cartridge_type);
+        return lz4_failed(&lz4_state) ? 0 : banks;
+    }
+
+    // dat_buf is not in use while loading the CRT chips
+    CRT_FILE_BUF file_buf;
+    crt_file_buf_init(&file_buf, crt_file, dat_buf, sizeof(dat_buf));
+    return crt_read_chips(crt_file_buf_read, &file_buf, cartridge_type);
+}
+
 static void crt_install_eapi(u16 cartridge_type)
 {
     if (cartridge_type == CRT_EASYFLASH &&
@@ -519,6 +673,29 @@ static inline u8 device_number_d64(void)
     return get_device_number(cfg_file.flags);
 }
 
+static u32 get_reu_size(u8 flags)
+{
+    u8 shift = flags & CFG_FLAG_REU_SIZE_MSK;
+    return REU_MAX_SIZE >> (shift >> CFG_FLAG_REU_SIZE_POS);
+}
+
+static void set_reu_size(u8 *flags, u32 size)
+{
+    u8 shift = 0;
+    while ((REU_MAX_SIZE >> shift) > size)
+    {
+        shift++;
+    }
+
+    MODIFY_REG(*flags, CFG_FLAG_REU_SIZE_MSK,
+               (shift << CFG_FLAG_REU_SIZE_POS) & CFG_FLAG_REU_SIZE_MSK);
+}
+
+static inline u32 reu_size(void)
+{
+    return get_reu_size(cfg_file.flags);
+}
+
 static char * basic_get_filename(FILINFO *file_info)
 {
     char *filename = file_info->fname;
@@ -620,6 +797,13 @@ static void send_prg(u16 size, const char *name)
 
 static u16 load_prg(char *name)
 {
+    // Already in memory
+    if (cfg_file.img.mode == PRG_MODE_USB)
+    {
+        sprint(name, "USB");
+        return usb_push_prg_size;
+    }
+
     if (!cfg_file.file[0] || !chdir_last())
     {
         return 0;
@@ -729,6 +913,118 @@ static bool load_crt(void)
     return true;
 }
 
+// Disk list (.lst or .m3u) with an image filename on each line. The images
+// are stored with their absolute path, packed after each other
+#define DISK_SWAP_MAX 8
+
+typedef struct
+{
+    u8 count;
+    u8 current;
+    u16 files[DISK_SWAP_MAX];   // Offset of each path in paths
+    char paths[1024];
+} DISK_SWAP_LIST;
+
+static DISK_SWAP_LIST disk_swap;
+
+static inline const char * disk_swap_file(u8 index)
+{
+    return disk_swap.paths + disk_swap.files[index];
+}
+
+static bool disk_swap_add(const char *filename)
+{
+    // Relative to the directory of the list (the current directory)
+    const char *path = "";
+    const char *separator = "";
+    if (*filename != '/')
+    {
+        path = cfg_file.path;
+        u32 len = strlen(path);
+        separator = len && path[len-1] == '/' ? "" : "/";
+    }
+
+    u32 used = disk_swap.count ?
+        disk_swap.files[disk_swap.count-1] +
+        strlen(disk_swap_file(disk_swap.count-1)) + 1 : 0;
+    u32 len = strlen(path) + strlen(separator) + strlen(filename) + 1;
+    if (used + len > sizeof(disk_swap.paths))
+    {
+        wrn("Disk list is too long");
+        return false;
+    }
+
+    disk_swap.files[disk_swap.count++] = used;
+    sprint(disk_swap.paths + used, "%s%s%s", path, separator, filename);
+    return true;
+}
+
+static bool disk_swap_is_list(const char *filename)
+{
+    FILINFO file_info;
+    return file_stat(filename, &file_info) &&
+           get_file_type(&file_info) == FILE_LST;
+}
+
+static bool disk_swap_load(const char *filename)
+{
+    disk_swap.count = disk_swap.current = 0;
+
+    FIL file;
+    if (!file_open(&file, filename, FA_READ))
+    {
+        return false;
+    }
+
+    u32 len = file_read(&file, scratch_buf, sizeof(scratch_buf) - 1);
+    file_close(&file);
+    scratch_buf[len] = 0;
+
+    char *line = scratch_buf;
+    if (memcmp(line, "\xef\xbb\xbf", 3) == 0)
+    {
+        line += 3;  // Skip UTF-8 BOM
+    }
+
+    while (*line && disk_swap.count < DISK_SWAP_MAX)
+    {
+        char *end = line;
+        while (*end && *end != '\r' && *end != '\n')
+        {
+            end++;
+        }
+
+        char *next = *end ? end + 1 : end;
+        while (end > line && end[-1] == ' ')
+        {
+            end--;
+        }
+        *end = 0;
+
+        // Skip empty lines and comments
+        if (*line && *line != '#' && end - line <= FF_LFN_BUF)
+        {
+            FILINFO file_info;
+            if (file_stat(line, &file_info) &&
+                get_file_type(&file_info) == FILE_D64)
+            {
+                if (!disk_swap_add(line))
+                {
+                    break;
+                }
+            }
+            else
+            {
+                wrn("Skipping %s in disk list", line);
+            }
+        }
+
+        line = next;
+    }
+
+    return disk_swap.count != 0;
+}
+
 static bool load_disk(void)
 {
     if (!chdir_last())
@@ -736,9 +1032,21 @@ static bool load_disk(void)
         return false;
     }
 
+    disk_swap.count = 0;
     if (cfg_file.img.mode == DISK_MODE_D64)
     {
-        D64_STATE *state = d64_open_image(cfg_file.file);
+        const char *filename = cfg_file.file;
+        if (disk_swap_is_list(filename))
+        {
+            if (!disk_swap_load(filename))
+            {
+                return false;
+            }
+
+            filename = disk_swap_file(0);
+        }
+
+        D64_STATE *state = d64_open_image(filename);
         if (!state)
         {
             return false;
@@ -803,9 +1111,9 @@ static bool load_disk(void)
     return true;
 }
 
-static bool load_txt(void)
+static bool load_snapshot(void)
 {
-    if (!cfg_file.file[0] || !chdir_last())
+    if (!chdir_last())
     {
         return false;
     }
@@ -816,16 +1124,112 @@ static bool load_txt(void)
         return false;
     }
 
-    txt_load_file(&file);
+    crt_buf_invalidate();
+    KFS_HEADER *header = KFS_HEADER_BUF;
+    bool result =
+        file_read(&file, header, sizeof(KFS_HEADER)) == sizeof(KFS_HEADER) &&
+        file_read(&file, KFS_RAM_BUF, KFS_RAM_SIZE) == KFS_RAM_SIZE;
+    file_close(&file);
+
+    if (!result || memcmp(KFS_SIGNATURE, header->signature,
+                          sizeof(header->signature)) != 0)
+    {
+        wrn("Invalid snapshot file");
+        return false;
+    }
+
+    // Mount the disk in use when the snapshot was saved
+    cfg_file.flags = (cfg_file.flags & ~CFG_FLAG_DEVICE_D64_MSK) |
+                     (header->flags & CFG_FLAG_DEVICE_D64_MSK);
+    cfg_file.img = header->img;
+    if (cfg_file.img.mode == DISK_MODE_D64)
+    {
+        cfg_file.img.element = 0;   // No need to look up the file
+    }
+    memcpy(cfg_file.path, header->path, sizeof(cfg_file.path));
+    memcpy(cfg_file.file, header->file, sizeof(cfg_file.file));
+
+    return load_disk();
+}
+
+static bool load_txt(void)
+{
+    if (!cfg_file.file[0] || !chdir_last())
+    {
+        return false;
+    }
+
+    if (!file_open(&txt_file, cfg_file.file, FA_READ))
+    {
+        return false;
+    }
+
+    TXT_PAGES[0] = 0;
+    txt_page_count = 1;
     return true;
 }
 
-static void start_text_reader(void)
+// Send a window of text starting at the page
+static void txt_send_page(u16 page)
 {
     format_path(scratch_buf, true);
     c64_send_data(scratch_buf, DIR_NAME_LENGTH);
-    c64_send_text_reader((char *)&KFF_BUF[DIR_NAME_LENGTH+2],
-                         sizeof(KFF_BUF) - (DIR_NAME_LENGTH+3));
+
+    u32 offset = TXT_PAGES[page];
+    u32 len = 0;
+    if (file_seek(&txt_file, offset))
+    {
+        len = file_read(&txt_file, scratch_buf, TXT_WINDOW_SIZE);
+    }
+    scratch_buf[len] = 0;
+
+    // Text ends at the end of the file or at the first NUL character
+    u8 more = strlen(scratch_buf) == len &&
+              offset + len < f_size(&txt_file);
+
+    c64_send_data(&page, 2);
+    c64_send_byte(more);
+    c64_send_petscii(scratch_buf, TXT_WINDOW_SIZE + 1);
+}
+
+static void start_text_reader(void)
+{
+    u8 cmd = CMD_TEXT_READER;
+    u16 page = 0;
+
+    while (true)
+    {
+        c64_set_command(cmd);
+        u8 reply;
+        while (!c64_get_reply(cmd, &reply))
+        {
+            log_poll();
+        }
+
+        if (reply != REPLY_TEXT_PAGE)
+        {
+            break;
+        }
+
+        // The launcher sends the length of the text it could show on the
+        // current page which gives the start of the next page
+        u16 next_page, len;
+        c64_receive_data(&next_page, 2);
+        c64_receive_data(&len, 2);
+
+        if (len && page + 1 == txt_page_count && txt_page_count < TXT_MAX_PAGES)
+        {
+            TXT_PAGES[txt_page_count++] = TXT_PAGES[page] + len;
+        }
+
+        if (next_page < txt_page_count)
+        {
+            page = next_page;
+        }
+
+        txt_send_page(page);
+        cmd = CMD_TEXT_PAGE;
+    }
 }
 
 static void c64_launcher_mode(void)
@@ -844,13 +1248,13 @@ static void c64_launcher_enable(void)
 static void c64_launcher_reu_mode(void)
 {
     crt_ptr = CRT_LAUNCHER;
-    kff_reu_init();
+    kff_reu_init(reu_size());
     C64_INSTALL_HANDLER(kff_reu_handler);
 }
 
 static void c64_reu_mode(void)
 {
-    reu_init();
+    reu_init(reu_size());
     C64_INSTALL_HANDLER(reu_handler);
 }
 
@@ -923,8 +1327,11 @@ static bool c64_set_mode(void)
         break;
 
         case CFG_DISK:
+        case CFG_SNAPSHOT:
         {
-            if (!load_disk())
+            bool loaded = cfg_file.boot_type == CFG_DISK ?
+                load_disk() : load_snapshot();
+            if (!loaded)
             {
                 break;
             }
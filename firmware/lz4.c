@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2019-2025 Kim Jørgensen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+/******************************************************************************
+* Streaming decoder for the LZ4 frame format (.lz4 files).
+* The decoded data is kept in a 64k window as matches can refer back to it.
+* Dictionary IDs are not supported and checksums are ignored.
+* https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+******************************************************************************/
+#define LZ4_MAGIC           0x184d2204
+#define LZ4_FLG_VERSION     0x40
+#define LZ4_FLG_VERSION_MSK 0xc0
+#define LZ4_FLG_B_CHECKSUM  0x10
+#define LZ4_FLG_C_SIZE      0x08
+#define LZ4_FLG_DICT_ID     0x01
+#define LZ4_BLOCK_RAW       0x80000000
+#define LZ4_MIN_MATCH       4
+#define LZ4_WINDOW_MASK     (sizeof(lz4_window) - 1)
+
+typedef enum
+{
+    LZ4_BLOCK = 0x00,   // Next is block size
+    LZ4_TOKEN,          // Next is sequence token or end of block
+    LZ4_LITERALS,       // Copying literals
+    LZ4_MATCH,          // Copying match
+    LZ4_RAW,            // Copying uncompressed block
+    LZ4_END,
+    LZ4_ERROR
+} LZ4_STATE_TYPE;
+
+typedef struct
+{
+    FIL *file;          // NULL if file is not LZ4 compressed
+    u8 flags;
+    u8 state;           // LZ4_STATE_TYPE
+    u8 token;
+    u16 offset;         // Match offset
+    u32 length;         // Bytes left of literals, match or raw block
+    u32 block_left;     // Compressed bytes left of block
+    u32 pos;            // Bytes decoded
+
+    u16 in_pos;
+    u16 in_len;
+    u8 in_buf[2*1024];
+} LZ4_STATE;
+
+static LZ4_STATE lz4_state;
+
+static inline bool lz4_getc(LZ4_STATE *state, u8 *c)
+{
+    if (state->in_pos >= state->in_len)
+    {
+        state->in_pos = 0;
+        state->in_len = file_read(state->file, state->in_buf,
+                                  sizeof(state->in_buf));
+        if (!state->in_len)
+        {
+            return false;
+        }
+    }
+
+    state->block_left--;
+    *c = state->in_buf[state->in_pos++];
+    return true;
+}
+
+static bool lz4_get32(LZ4_STATE *state, u32 *value)
+{
+    u8 c;
+    *value = 0;
+    for (u8 i=0; i<32; i+=8)
+    {
+        if (!lz4_getc(state, &c))
+        {
+            return false;
+        }
+        *value |= c << i;
+    }
+
+    return true;
+}
+
+static bool lz4_skip(LZ4_STATE *state, u8 bytes)
+{
+    u8 c;
+    while (bytes--)
+    {
+        if (!lz4_getc(state, &c))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool lz4_get_length(LZ4_STATE *state, u32 *length)
+{
+    u8 c = 0xff;
+    while (c == 0xff)
+    {
+        if (!lz4_getc(state, &c))
+        {
+            return false;
+        }
+        *length += c;
+    }
+
+    return true;
+}
+
+// Returns false if file is not LZ4 compressed (file position is unchanged)
+static bool lz4_open(LZ4_STATE *state, FIL *file)
+{
+    state->file = file;
+    state->in_pos = 0;
+    state->in_len = 0;
+
+    u32 magic;
+    if (!lz4_get32(state, &magic) || magic != LZ4_MAGIC)
+    {
+        state->file = NULL;
+        file_seek(file, 0);
+        return false;
+    }
+
+    u8 bd;
+    if (!lz4_getc(state, &state->flags) || !lz4_getc(state, &bd) ||
+        (state->flags & LZ4_FLG_VERSION_MSK) != LZ4_FLG_VERSION ||
+        (state->flags & LZ4_FLG_DICT_ID))
+    {
+        wrn("Unsupported LZ4 frame");
+        state->state = LZ4_ERROR;
+        return true;
+    }
+
+    // Skip content size and header checksum
+    u8 skip = (state->flags & LZ4_FLG_C_SIZE) ? 8 + 1 : 1;
+    state->state = lz4_skip(state, skip) ? LZ4_BLOCK : LZ4_ERROR;
+    state->pos = 0;
+    return true;
+}
+
+static inline bool lz4_is_open(LZ4_STATE *state, FIL *file)
+{
+    return state->file == file;
+}
+
+static inline bool lz4_failed(LZ4_STATE *state)
+{
+    return state->state == LZ4_ERROR;
+}
+
+static bool lz4_end_block(LZ4_STATE *state)
+{
+    state->state = LZ4_BLOCK;
+    return !(state->flags & LZ4_FLG_B_CHECKSUM) || lz4_skip(state, 4);
+}
+
+// crt_read_func for LZ4 compressed files. Returns number of bytes decoded
+static u32 lz4_read(void *source, void *buf, u32 size)
+{
+    LZ4_STATE *state = (LZ4_STATE *)source;
+    u8 *out = (u8 *)buf;
+    u8 *out_end = out + size;
+    u32 pos = state->pos;
+    bool ok = true;
+    u8 c;
+
+    while (out < out_end && ok)
+    {
+        switch (state->state)
+        {
+            case LZ4_BLOCK:
+            {
+                u32 block_size;
+                ok = lz4_get32(state, &block_size);
+                if (!ok || !block_size)
+                {
+                    state->state = LZ4_END;
+                    break;
+                }
+
+                state->block_left = block_size & ~LZ4_BLOCK_RAW;
+                if (block_size & LZ4_BLOCK_RAW)
+                {
+                    state->length = state->block_left;
+                    state->state = LZ4_RAW;
+                }
+                else
+                {
+                    state->state = LZ4_TOKEN;
+                }
+            }
+            break;
+
+            case LZ4_TOKEN:
+            {
+                if (!state->block_left)
+                {
+                    ok = lz4_end_block(state);
+                    break;
+                }
+
+                ok = lz4_getc(state, &state->token);
+                state->length = state->token >> 4;
+                if (ok && state->length == 0x0f)
+                {
+                    ok = lz4_get_length(state, &state->length);
+                }
+                state->state = LZ4_LITERALS;
+            }
+            break;
+
+            case LZ4_LITERALS:
+            {
+                while (state->length && out < out_end)
+                {
+                    ok = lz4_getc(state, &c);
+                    if (!ok)
+                    {
+                        break;
+                    }
+
+                    lz4_window[pos++ & LZ4_WINDOW_MASK] = c;
+                    *out++ = c;
+                    state->length--;
+                }
+
+                if (state->length || !ok)
+                {
+                    break;
+                }
+
+                // Last sequence of the block has no match
+                if (!state->block_left)
+                {
+                    state->state = LZ4_TOKEN;
+                    break;
+                }
+
+                u8 lo, hi;
+                ok = lz4_getc(state, &lo) && lz4_getc(state, &hi);
+                state->offset = lo | (hi << 8);
+                if (!state->offset || state->offset > pos)
+                {
+                    ok = false;
+                    break;
+                }
+
+                state->length = (state->token & 0x0f) + LZ4_MIN_MATCH;
+                if (state->length == 0x0f + LZ4_MIN_MATCH)
+                {
+                    ok = lz4_get_length(state, &state->length);
+                }
+                state->state = LZ4_MATCH;
+            }
+            break;
+
+            case LZ4_MATCH:
+            {
+                while (state->length && out < out_end)
+                {
+                    c = lz4_window[(pos - state->offset) & LZ4_WINDOW_MASK];
+                    lz4_window[pos++ & LZ4_WINDOW_MASK] = c;
+                    *out++ = c;
+                    state->length--;
+                }
+
+                if (!state->length)
+                {
+                    state->state = LZ4_TOKEN;
+                }
+            }
+            break;
+
+            case LZ4_RAW:
+            {
+                while (state->length && out < out_end)
+                {
+                    ok = lz4_getc(state, &c);
+                    if (!ok)
+                    {
+                        break;
+                    }
+
+                    lz4_window[pos++ & LZ4_WINDOW_MASK] = c;
+                    *out++ = c;
+                    state->length--;
+                }
+
+                if (ok && !state->length)
+                {
+                    ok = lz4_end_block(state);
+                }
+            }
+            break;
+
+            default:
+                out_end = out;  // End of frame or error
+                break;
+        }
+    }
+
+    if (!ok)
+    {
+        err("Failed to decode LZ4 file");
+        state->state = LZ4_ERROR;
+    }
+
+    state->pos = pos;
+    return out - (u8 *)buf;
+}
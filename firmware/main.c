@@ -34,6 +34,7 @@
 #include "commands.c"
 #include "disk_drive.h"
 #include "menu.c"
+#include "snapshot.c"
 #include "disk_drive.c"
 #include "eapi.c"
 #include "diagnostic.c"
@@ -63,7 +64,8 @@ int main(void)
         menu_loop();
     }
 
-    if (cfg_file.boot_type == CFG_CRT || cfg_file.boot_type == CFG_DISK)
+    if (cfg_file.boot_type == CFG_CRT || cfg_file.boot_type == CFG_DISK ||
+        cfg_file.boot_type == CFG_SNAPSHOT)
     {
 #if !(LOG_USB)
         // Disable all interrupts besides the C64 bus handler beyond this point
@@ -85,7 +87,12 @@ int main(void)
     }
     else if (cfg_file.boot_type == CFG_DISK)
     {
-        disk_loop();
+        disk_loop(CMD_MOUNT_DISK);
+    }
+    else if (cfg_file.boot_type == CFG_SNAPSHOT)
+    {
+        snapshot_restore();
+        disk_loop(CMD_NONE);
     }
     else if (cfg_file.boot_type == CFG_CRT &&
              cfg_file.crt.type == CRT_EASYFLASH)
@@ -100,6 +107,8 @@ int main(void)
     dbg("In main loop...");
     while (true)
     {
+        log_poll();
+
         // Forward data from USB to C64
         if (usb_gotc() && ef3_can_putc())
         {
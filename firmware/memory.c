@@ -65,6 +65,7 @@ static bool crt_buf_is_updated(void)
 static inline void crt_buf_invalidate(void)
 {
     crt_buf_header.signature[0] = 0;
+    reu_buf_header.signature[0] = 0;
 }
 
 static bool crt_bank_empty(u8 *buf, u16 size)
@@ -80,3 +81,40 @@ static bool crt_bank_empty(u8 *buf, u16 size)
 
     return true;
 }
+
+/******************************************************************************
+* REU image in CRT image buffer
+******************************************************************************/
+static u32 reu_buf_checksum(void)
+{
+    u32 *buf32 = (u32 *)crt_buf;
+    u32 checksum = 0;
+    for (u32 i=0; i<reu_buf_header.size/4; i++)
+    {
+        checksum = ((checksum << 1) | (checksum >> 31)) + buf32[i];
+    }
+
+    return checksum;
+}
+
+static void reu_buf_valid(u32 size)
+{
+    memcpy(reu_buf_header.signature, REU_BUF_SIGNATURE,
+           sizeof(REU_BUF_SIGNATURE));
+
+    reu_buf_header.size = size;
+    reu_buf_header.checksum = reu_buf_checksum();
+}
+
+static inline bool reu_buf_is_valid(void)
+{
+    return memcmp(reu_buf_header.signature, REU_BUF_SIGNATURE,
+                  sizeof(REU_BUF_SIGNATURE)) == 0;
+}
+
+// REU image has been changed by the C64 since it was loaded or saved
+static bool reu_buf_is_updated(void)
+{
+    return reu_buf_is_valid() &&
+           reu_buf_header.checksum != reu_buf_checksum();
+}
@@ -33,12 +33,29 @@ typedef struct
 __attribute__((__section__(".uninit")))
 static CRT_BUF_HEADER crt_buf_header;
 
+#define REU_BUF_SIGNATURE  "KungFu::REU"
+
+typedef struct
+{
+    u32 signature[sizeof(REU_BUF_SIGNATURE)/4]; // REU_BUF_SIGNATURE
+    u32 size;       // Size of REU image loaded to the start of crt_buf
+    u32 checksum;   // Checksum of REU image when loaded or saved
+    char path[750]; // Location of REU image file
+    char file[256];
+} REU_BUF_HEADER;
+
+__attribute__((__section__(".uninit")))
+static REU_BUF_HEADER reu_buf_header;
+
 // 1024kB buffer for CRT image
 __attribute__((__section__(".sram1.1"))) static u8 crt_buf[1024*1024];
 
 // 64kB data buffer
 __attribute__((__section__(".sram2.1"))) static u8 dat_buf[64*1024];
 
+// 64kB window for decompression of LZ4 files
+__attribute__((__section__(".sram2.2"))) static u8 lz4_window[64*1024];
+
 // 32kB buffer for CRT RAM
 __attribute__((__section__(".uninit.1"))) static u8 crt_ram_buf[32*1024];
 
@@ -25,7 +25,9 @@
 #include "menu_options.h"
 #include "d64.c"
 #include "t64.c"
+#include "lz4.c"
 #include "loader.c"
+#include "usb_push.c"
 #include "menu_sd.c"
 #include "menu_d64.c"
 #include "menu_t64.c"
@@ -47,12 +49,18 @@ static void menu_loop(void)
         u8 reply;
         while (!c64_get_reply(cmd, &reply))
         {
+            log_poll();
             if (usb_gotc())
             {
-                cfg_file.boot_type = CFG_USB;
                 should_save_cfg = false;
                 cmd = CMD_WAIT_SYNC;
                 c64_disable();
+
+                // Use EF3 USB protocol if image isn't pushed to memory
+                if (!usb_push_load())
+                {
+                    cfg_file.boot_type = CFG_USB;
+                }
                 break;
             }
         }
@@ -185,18 +193,33 @@ static u8 handle_unsupported_warning(const char *message, const char *file_name,
     return handle_options();
 }
 
-static u8 handle_unsaved_crt(const char *file_name, void (*handle_save)(u8))
+static u8 handle_unsaved_crt(const char *file_name, void (*handle_save)(u8),
+                             bool can_overwrite)
 {
     OPTIONS_STATE *options = build_options("Unsaved changes",
                                            "How do you want to save the changes  to CRT?");
     options_add_text_block(options, file_name);
-    options_add_callback(options, handle_save, "Overwrite file", SELECT_FLAG_OVERWRITE);
+    if (can_overwrite)
+    {
+        options_add_callback(options, handle_save, "Overwrite file", SELECT_FLAG_OVERWRITE);
+    }
     options_add_callback(options, handle_save, "New file", 0);
     options_add_dir(options, "Cancel");
 
     return handle_options();
 }
 
+static u8 handle_unsaved_reu(const char *file_name, void (*handle_save)(u8))
+{
+    OPTIONS_STATE *options = build_options("Unsaved changes",
+                                           "Save the changes to the REU image?");
+    options_add_text_block(options, file_name);
+    options_add_callback(options, handle_save, "Overwrite file", SELECT_FLAG_OVERWRITE);
+    options_add_dir(options, "Cancel");
+
+    return handle_options();
+}
+
 static u8 handle_file_options(const char *file_name, u8 file_type, u8 element_no)
 {
     const char *title = "File Options";
@@ -220,13 +243,19 @@ static u8 handle_file_options(const char *file_name, u8 file_type, u8 element_no
             vic_text = "Run (VIC-II/C128 mode)";
             // fall through
         case FILE_ROM:
+        case FILE_KFS:
             select_text = "Run";
             break;
 
         case FILE_P00:
+        case FILE_REU:
             select_text = "Load";
             break;
 
+        case FILE_LST:
+            select_text = "Mount";
+            break;
+
         case FILE_D64:
             select_text = "Open";
             mount_text = "Mount";
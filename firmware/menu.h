@@ -34,7 +34,9 @@ static void fail_to_read_sd(void);
 static u8 handle_unsupported(const char *file_name);
 static u8 handle_unsupported_ex(const char *title, const char *message, const char *file_name);
 static u8 handle_unsupported_warning(const char *message, const char *file_name, u8 element_no);
-static u8 handle_unsaved_crt(const char *file_name, void (*handle_save)(u8));
+static u8 handle_unsaved_crt(const char *file_name, void (*handle_save)(u8),
+                             bool can_overwrite);
+static u8 handle_unsaved_reu(const char *file_name, void (*handle_save)(u8));
 static u8 handle_file_options(const char *file_name, u8 file_type, u8 element_no);
 static u8 handle_upgrade_menu(const char *firmware, u8 element_no);
 static const char * to_petscii_pad(char *dest, const char *src, u8 size);
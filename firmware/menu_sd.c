@@ -231,7 +231,18 @@ static void sd_handle_save_updated_crt(u8 flags)
 
     if (!(flags & SELECT_FLAG_OVERWRITE))
     {
+        FILINFO file_info;
         bool file_exists = true;
+
+        // Save a compressed CRT uncompressed (x.crt.lz4 -> x.crt)
+        if (is_lz4_file(cfg_file.file))
+        {
+            u8 extension;
+            get_filename_length(cfg_file.file, &extension);
+            cfg_file.file[extension] = 0;
+            file_exists = file_stat(cfg_file.file, &file_info);
+        }
+
         while (file_exists)
         {
             if (!sd_generate_new_filename())
@@ -244,7 +255,6 @@ static void sd_handle_save_updated_crt(u8 flags)
                                         cfg_file.file);
             }
 
-            FILINFO file_info;
             file_exists = file_stat(cfg_file.file, &file_info);
         }
     }
@@ -279,11 +289,42 @@ static bool sd_crt_updated(SD_STATE *state)
     return true;
 }
 
+static void sd_handle_save_updated_reu(u8 flags)
+{
+    sd_send_prg_message("Saving REU image.");
+    if (!reu_save_file())
+    {
+        sd_send_warning_restart("Failed to write REU image",
+                                reu_buf_header.file);
+    }
+
+    restart_to_menu();
+}
+
+static bool sd_reu_updated(SD_STATE *state)
+{
+    if (state->ignore_reu_updated)
+    {
+        return false;
+    }
+
+    state->ignore_reu_updated = true;   // Only check once
+    return reu_buf_is_updated();
+}
+
 static u8 sd_handle_dir(SD_STATE *state)
 {
     if (sd_crt_updated(state))
     {
-        return handle_unsaved_crt(cfg_file.file, sd_handle_save_updated_crt);
+        // A compressed CRT cannot be overwritten with an uncompressed one
+        return handle_unsaved_crt(cfg_file.file, sd_handle_save_updated_crt,
+                                  !is_lz4_file(cfg_file.file));
+    }
+
+    if (sd_reu_updated(state))
+    {
+        return handle_unsaved_reu(reu_buf_header.file,
+                                  sd_handle_save_updated_reu);
     }
 
     sd_dir_open(state);
@@ -689,6 +730,39 @@ static u8 sd_handle_load(SD_STATE *state, const char *file_name, u8 file_type,
         }
         break;
 
+        case FILE_KFS:
+        {
+            cfg_file.boot_type = CFG_SNAPSHOT;
+            return CMD_WAIT_SYNC;
+        }
+        break;
+
+        case FILE_LST:
+        {
+            cfg_file.img.mode = DISK_MODE_D64;
+            cfg_file.img.element = ELEMENT_NOT_SELECTED;
+            cfg_file.boot_type = CFG_DISK;
+            return CMD_WAIT_SYNC;
+        }
+        break;
+
+        case FILE_REU:
+        {
+            sd_send_prg_message("Loading REU image.");
+            FIL file;
+            sd_file_open(&file, file_name);
+
+            if (!reu_load_file(&file, file_name))
+            {
+                sd_send_warning_restart("Failed to read REU image", file_name);
+            }
+            file_close(&file);
+
+            c64_interface_sync();
+            return CMD_MENU;
+        }
+        break;
+
         case FILE_UPD:
         {
             FIL file;
@@ -795,7 +869,9 @@ static u8 sd_handle_select(SD_STATE *state, u8 flags, u8 element)
         return sd_handle_delete_file(file_info.fname);
     }
 
-    if (!(flags & SELECT_FLAG_MOUNT) && file_type == FILE_PRG)
+    // Compressed PRG files cannot be loaded from the drive
+    if (!(flags & SELECT_FLAG_MOUNT) && file_type == FILE_PRG &&
+        !is_lz4_file(file_info.fname))
     {
         cfg_file.img.mode = DISK_MODE_FS;
         cfg_file.boot_type = CFG_DISK;
@@ -28,6 +28,7 @@ typedef struct
     u16 page_no;
 
     bool ignore_crt_updated;
+    bool ignore_reu_updated;
 
     char search[SEARCH_LENGTH+2];
 } SD_STATE;
@@ -54,15 +54,28 @@ static u8 settings_basic_change(OPTIONS_STATE *state, OPTIONS_ELEMENT *element,
 
 static const char * settings_expansion_text(void)
 {
-    return setting_print("RAM expansion (REU)",
-        settings_flags & CFG_FLAG_REU_DISABLED ? "no" : "yes");
+    const char *text = "no";
+    if (!(settings_flags & CFG_FLAG_REU_DISABLED))
+    {
+        text = scratch_buf+ELEMENT_LENGTH;
+        sprint(scratch_buf+ELEMENT_LENGTH, "%uK", get_reu_size(settings_flags) / 1024);
+    }
+
+    return setting_print("RAM expansion (REU)", text);
 }
 
+// Cycle between no, 128K, 256K, 512K and 1024K
 static u8 settings_expansion_change(OPTIONS_STATE *state, OPTIONS_ELEMENT *element, u8 flags)
 {
+    u32 size = get_reu_size(settings_flags);
     if (settings_flags & CFG_FLAG_REU_DISABLED)
     {
         settings_flags &= ~CFG_FLAG_REU_DISABLED;
+        set_reu_size(&settings_flags, REU_MIN_SIZE);
+    }
+    else if (size < REU_MAX_SIZE)
+    {
+        set_reu_size(&settings_flags, size * 2);
     }
     else
     {
@@ -117,6 +130,19 @@ static u8 settings_save(OPTIONS_STATE *state, OPTIONS_ELEMENT *element, u8 flags
     return CMD_NONE;
 }
 
+static u8 settings_usb_storage(OPTIONS_STATE *state, OPTIONS_ELEMENT *element, u8 flags)
+{
+    sd_send_prg_message("USB drive active. Press menu to exit");
+    save_cfg();
+
+    // Host has exclusive access to the SD card
+    filesystem_unmount();
+    usb_msc_loop();
+    restart_to_menu();
+
+    return CMD_NONE;
+}
+
 static u8 handle_settings(void)
 {
     settings_flags = cfg_file.flags;
@@ -126,6 +152,7 @@ static u8 handle_settings(void)
     options_add_text_element(options, settings_expansion_change, settings_expansion_text());
     options_add_text_element(options, settings_autostart_change, settings_autostart_text());
     options_add_text_element(options, settings_device_change, settings_device_text());
+    options_add_text_element(options, settings_usb_storage, "USB mass storage");
     options_add_text_element(options, settings_save, "Save");
     options_add_dir(options, "Cancel");
     return handle_options();
@@ -101,7 +101,8 @@ static void printint(int _x, int sgnd, int ndigits, void (*_putchar)(char))
     }
 }
 
-static void vkprint(const char *fmt, va_list args, void (*_putchar)(char))
+static void kprint(const char *fmt, u32 (*next_arg)(void *, char), void *ctx,
+                   void (*_putchar)(char))
 {
     char *s;
     int ndigits = 0;
@@ -127,10 +128,10 @@ static void vkprint(const char *fmt, va_list args, void (*_putchar)(char))
             _putchar('%');
             break;
         case 'c':
-            _putchar(va_arg(args, int));
+            _putchar(next_arg(ctx, *fmt));
             break;
         case 's':
-            s = va_arg(args, char *);
+            s = (char *)next_arg(ctx, *fmt);
 
             ndigits -= strlen(s);
 
@@ -153,17 +154,17 @@ static void vkprint(const char *fmt, va_list args, void (*_putchar)(char))
             // fall through
         case 'x':
         case 'X':
-            printhex(va_arg(args, int), ndigits, _putchar);
+            printhex(next_arg(ctx, *fmt), ndigits, _putchar);
             ndigits = 0;
             break;
 
         case 'd':
-            printint(va_arg(args, unsigned int), 1, ndigits, _putchar);
+            printint(next_arg(ctx, *fmt), 1, ndigits, _putchar);
             ndigits = 0;
             break;
 
         case 'u':
-            printint(va_arg(args, unsigned int), 0, ndigits, _putchar);
+            printint(next_arg(ctx, *fmt), 0, ndigits, _putchar);
             ndigits = 0;
             break;
 
@@ -182,6 +183,19 @@ static void vkprint(const char *fmt, va_list args, void (*_putchar)(char))
     }
 }
 
+static u32 va_next_arg(void *ctx, char conv)
+{
+    return va_arg(*(va_list *)ctx, u32);
+}
+
+static void vkprint(const char *fmt, va_list args, void (*_putchar)(char))
+{
+    va_list ap;
+    va_copy(ap, args);
+    kprint(fmt, va_next_arg, &ap, _putchar);
+    va_end(ap);
+}
+
 static char *buf_putchar_buf;
 static int buf_putchar_buflen;
 
@@ -190,27 +204,241 @@ static void buf_putchar(char c)
     buf_putchar_buf[buf_putchar_buflen++] = c;
 }
 
+#if (LOG_ASYNC)
+/******************************************************************************
+* Asynchronous log. Messages are stored in a ring buffer as the format pointer
+* and the raw arguments (strings are copied). Formatting and output is done
+* by log_poll() when the firmware is idle. Messages are dropped if the buffer
+* is full. Must not be used from interrupts
+******************************************************************************/
+#define LOG_BUF_SIZE    0x1000   // Must be a power of 2
+#define LOG_BUF_MASK    (LOG_BUF_SIZE - 1)
+#define LOG_STR_MAX     32
+#define LOG_LINE_SIZE   160
+
+static u8 log_buf[LOG_BUF_SIZE];
+static u32 log_head;
+static u32 log_tail;
+static u32 log_dropped;
+static u32 log_dropped_reported;
+
+static char log_line[LOG_LINE_SIZE];
+static u16 log_line_len;
+static u16 log_line_pos;
+
+static char log_str[LOG_STR_MAX + 1];
+
+static bool log_write(u32 *head, const void *data, u32 size)
+{
+    if (*head + size - log_tail > LOG_BUF_SIZE)
+    {
+        return false;
+    }
+
+    const u8 *src = (const u8 *)data;
+    while (size--)
+    {
+        log_buf[(*head)++ & LOG_BUF_MASK] = *src++;
+    }
+
+    return true;
+}
+
+static void log_read(u32 *tail, void *data, u32 size)
+{
+    u8 *dst = (u8 *)data;
+    while (size--)
+    {
+        *dst++ = log_buf[(*tail)++ & LOG_BUF_MASK];
+    }
+}
+
+static void log_push(const char *level, const char *fmt, va_list args)
+{
+    u32 head = log_head;
+    bool result = log_write(&head, &level, sizeof(level)) &&
+                  log_write(&head, &fmt, sizeof(fmt));
+
+    // Same parsing as kprint() to find the arguments
+    for (const char *p = fmt; *p && result; p++)
+    {
+        if (*p != '%')
+        {
+            continue;
+        }
+
+        p++;
+        while (isdigit(*p))
+        {
+            p++;
+        }
+
+        switch (*p)
+        {
+            case 's':
+            {
+                const char *str = va_arg(args, const char *);
+                u32 len = strlen(str);
+                if (len > LOG_STR_MAX)
+                {
+                    len = LOG_STR_MAX;
+                }
+
+                result = log_write(&head, str, len) &&
+                         log_write(&head, "", 1);
+            }
+            break;
+
+            case 'c':
+            case 'p':
+            case 'x':
+            case 'X':
+            case 'd':
+            case 'u':
+            {
+                u32 value = va_arg(args, u32);
+                result = log_write(&head, &value, sizeof(value));
+            }
+            break;
+
+            case 0:
+                p--;
+                break;
+        }
+    }
+
+    if (result)
+    {
+        __DMB();
+        log_head = head;
+    }
+    else
+    {
+        log_dropped++;
+    }
+}
+
+static u32 log_next_arg(void *ctx, char conv)
+{
+    u32 *tail = (u32 *)ctx;
+    if (conv == 's')
+    {
+        u32 i = 0;
+        while ((log_str[i] = log_buf[(*tail)++ & LOG_BUF_MASK]))
+        {
+            i++;
+        }
+
+        return (u32)log_str;
+    }
+
+    u32 value;
+    log_read(tail, &value, sizeof(value));
+    return value;
+}
+
+static void log_line_putchar(char c)
+{
+    if (log_line_len < LOG_LINE_SIZE)
+    {
+        log_line[log_line_len++] = c;
+    }
+}
+
+// Output as much of the log as possible without blocking
+static void log_poll(void)
+{
+    while (log_line_pos < log_line_len)
+    {
+        if (!can_put_char())
+        {
+            return;
+        }
+
+        put_char(log_line[log_line_pos++]);
+    }
+
+    log_line_len = 0;
+    log_line_pos = 0;
+
+    if (log_dropped != log_dropped_reported)
+    {
+        u32 dropped = log_dropped - log_dropped_reported;
+        log_dropped_reported = log_dropped;
+
+        sprint(log_line, "[WRN] %u log messages dropped\n", dropped);
+        log_line_len = strlen(log_line);
+        return;
+    }
+
+    if (log_head == log_tail)
+    {
+        return;
+    }
+
+    u32 tail = log_tail;
+    const char *level, *fmt;
+    log_read(&tail, &level, sizeof(level));
+    log_read(&tail, &fmt, sizeof(fmt));
+
+    if (level)
+    {
+        while (*level)
+        {
+            log_line_putchar(*level++);
+        }
+    }
+
+    kprint(fmt, log_next_arg, &tail, log_line_putchar);
+    if (level)
+    {
+        log_line_putchar('\n');
+    }
+
+    __DMB();
+    log_tail = tail;
+}
+
+// Output the complete log (blocking)
+static void log_flush(void)
+{
+    while (log_head != log_tail || log_line_pos < log_line_len ||
+           log_dropped != log_dropped_reported)
+    {
+        log_poll();
+    }
+}
+#endif
+
 /* Minimal printf functions. Supports strings, chars and hex numbers. */
 static void print(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
+#if (LOG_ASYNC)
+	log_push(NULL, fmt, args);
+#else
 	vkprint(fmt, args, put_char);
+#endif
 	va_end(args);
 }
 
 static void print_log(const char *level, const char *fmt, ...)
 {
 	va_list args;
+	va_start(args, fmt);
+#if (LOG_ASYNC)
+	log_push(level, fmt, args);
+#else
     while (*level)
     {
         put_char(*level++);
     }
 
-    va_start(args, fmt);
 	vkprint(fmt, args, put_char);
+	put_char('\n');
+#endif
 	va_end(args);
-    put_char('\n');
 }
 
 static void sprint(char *buf, const char *fmt, ...)
@@ -39,6 +39,7 @@
 
 #if (VERB >= V_CRT)
 #define LOG_USB 0   /* Set to 1 for logging to USB */
+#define LOG_ASYNC 1 /* Set to 0 for blocking output when logging */
 #endif
 
 #if (VERB >= V_CRT)
@@ -74,9 +75,19 @@
 #endif
 
 #if (LOG_USB)
-    #define put_char    usb_putc
+    #define put_char        usb_putc
+    #define can_put_char    usb_can_putc
 #else
-    #define put_char    usart_putc
+    #define put_char        usart_putc
+    #define can_put_char    usart_can_putc
+#endif
+
+#if (LOG_ASYNC)
+static void log_poll(void);
+static void log_flush(void);
+#else
+    #define log_poll()
+    #define log_flush()
 #endif
 
 #define isdigit(c)	((c) >= '0' && (c) <= '9')
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2019-2025 Kim Jørgensen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************
+ * Snapshot of the C64 in disk mode.
+ *
+ * The special button will NMI the C64 into the snapshot code of the launcher
+ * which sends the CPU registers and the I/O state and sets all RAM visible.
+ * The RAM is then read using DMA and the CPU is kept halted while the
+ * snapshot is saved. A snapshot is restored in the reverse order.
+ */
+
+static u8 *snapshot_dma_buf;
+static u32 snapshot_dma_addr;
+
+/******************************************************************************
+* C64 bus DMA callback (C64 RAM -> buffer)
+******************************************************************************/
+FORCE_INLINE void snapshot_read_dma_bus_handler(void)
+{
+    // The snapshot code has set $01 to $34 to make all RAM visible
+    C64_CRT_CONTROL(CRT_PORT_NONE);
+    C64_ADDR_WRITE(snapshot_dma_addr);
+
+    C64_DMA_DATA_READ();
+    snapshot_dma_buf[snapshot_dma_addr] = data;
+
+    if (++snapshot_dma_addr == KFS_RAM_SIZE)
+    {
+        // Keep DMA low to halt the CPU until the snapshot is resumed
+        C64_INTERFACE_DISABLE();
+    }
+}
+
+C64_DMA_BUS_HANDLER(snapshot_read)
+
+/******************************************************************************
+* C64 bus DMA callback (buffer -> C64 RAM)
+******************************************************************************/
+FORCE_INLINE void snapshot_write_dma_bus_handler(void)
+{
+    C64_CRT_CONTROL(CRT_PORT_NONE);
+    C64_ADDR_WRITE(snapshot_dma_addr);
+    C64_CONTROL_WRITE(C64_WRITE_LOW);
+    C64_DATA_WRITE(snapshot_dma_buf[snapshot_dma_addr]);
+
+    snapshot_dma_addr++;
+    C64_DMA_WRITE_END();
+
+    if (snapshot_dma_addr == KFS_RAM_SIZE)
+    {
+        C64_INTERFACE_DISABLE();
+    }
+}
+
+C64_DMA_BUS_HANDLER(snapshot_write)
+
+// Transfer all 64K of C64 RAM. The C64 bus handler is disabled afterwards
+static bool snapshot_dma(void (*handler)(void), u8 *buf)
+{
+    u32 c64_handler = C64_HANDLER;
+    snapshot_dma_buf = buf;
+    snapshot_dma_addr = 0;
+
+    C64_INSTALL_HANDLER(handler);
+    C64_DMA_HANDLER_ENABLE();
+    C64_CRT_CONTROL(C64_DMA_LOW);
+
+    // The transfer takes about 70 ms
+    timer_start_ms(500);
+    while (c64_interface_active())
+    {
+        if (timer_elapsed())
+        {
+            C64_INTERFACE_DISABLE();
+            break;
+        }
+    }
+
+    C64_INSTALL_HANDLER(c64_handler);
+    return snapshot_dma_addr == KFS_RAM_SIZE;
+}
+
+// Let the snapshot code continue and return from the NMI
+static void snapshot_resume(KFS_STATE *state)
+{
+    // Registers in the order read by the snapshot code
+    u8 *regs = KFF_BUF;
+    regs[0] = state->sp;
+    regs[1] = state->cpu_ddr;
+    regs[2] = state->cpu_port;
+    regs[3] = state->y;
+    regs[4] = state->x;
+    regs[5] = state->a;
+
+    // Leave Ultimax mode when RTI reads the PC high byte from the stack
+    kff_resume_addr = 0x100 + ((state->sp + 3) & 0xff);
+
+    C64_CRT_CONTROL(STATUS_LED_ON|CRT_PORT_ULTIMAX);
+    c64_interface_enable_no_config();
+    C64_CRT_CONTROL(C64_DMA_HIGH);
+}
+
+static void snapshot_write(KFS_HEADER *header)
+{
+    // Save next to the mounted disk
+    char *filename = (char *)(header + 1);
+    u32 len = strlen(cfg_file.path);
+    const char *separator = len && cfg_file.path[len-1] == '/' ? "" : "/";
+
+    u32 i = 0;
+    FILINFO file_info;
+    do
+    {
+        if (++i > 99)
+        {
+            wrn("Failed to generate snapshot filename");
+            return;
+        }
+
+        sprint(filename, "%s%sSNAPSHOT%2u.KFS", cfg_file.path, separator, i);
+    }
+    while (file_stat(filename, &file_info));
+
+    FIL file;
+    if (!file_open(&file, filename, FA_WRITE|FA_CREATE_NEW))
+    {
+        return;
+    }
+
+    bool result =
+        file_write(&file, header, sizeof(KFS_HEADER)) == sizeof(KFS_HEADER) &&
+        file_write(&file, dat_buf, KFS_RAM_SIZE) == KFS_RAM_SIZE;
+    result &= file_close(&file);
+
+    if (result)
+    {
+        log("Snapshot saved as %s", filename);
+    }
+    else
+    {
+        wrn("Failed to write snapshot %s", filename);
+    }
+}
+
+// Called from the disk loop when the C64 has been frozen
+static u8 snapshot_save(void)
+{
+    KFS_HEADER *header = (KFS_HEADER *)scratch_buf;
+    KFS_STATE *state = &header->state;
+    c64_receive_data(state, sizeof(KFS_STATE));
+
+    memcpy(header->signature, KFS_SIGNATURE, sizeof(header->signature));
+    header->flags = cfg_file.flags;
+    header->img = cfg_file.img;
+    memcpy(header->path, cfg_file.path, sizeof(header->path));
+    memcpy(header->file, cfg_file.file, sizeof(header->file));
+    memcpy(header->kff_ram, KFF_RAM, sizeof(header->kff_ram));
+
+    dbg("Saving snapshot. PC on stack at $01%x", (state->sp + 3) & 0xff);
+    if (snapshot_dma(snapshot_read_dma_handler, dat_buf))
+    {
+        snapshot_write(header);
+    }
+    else
+    {
+        wrn("Failed to read C64 RAM");
+    }
+
+    snapshot_resume(state);
+    return CMD_NONE;
+}
+
+// Called before the disk loop when booting a snapshot
+static void snapshot_restore(void)
+{
+    KFS_HEADER *header = KFS_HEADER_BUF;
+    KFS_STATE *state = &header->state;
+
+    // The I/O state is restored by the C64 before RAM is written
+    c64_send_data(state->vic, sizeof(state->vic));
+    c64_send_data(state->cia, sizeof(state->cia));
+    c64_send_data(state->color, sizeof(state->color));
+    c64_send_command(CMD_SNAPSHOT);
+
+    if (!snapshot_dma(snapshot_write_dma_handler, KFS_RAM_BUF))
+    {
+        wrn("Failed to write C64 RAM");
+        c64_disable();
+        restart_to_menu();
+    }
+
+    // Disk API in KFF RAM (registers are left untouched)
+    memcpy(KFF_RAM + 8, header->kff_ram + 8, sizeof(header->kff_ram) - 8);
+    snapshot_resume(state);
+}
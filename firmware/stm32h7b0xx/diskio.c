@@ -628,6 +628,24 @@ DRESULT disk_write(BYTE pdrv, const BYTE* buf, DWORD sector, UINT count)
     return result ? RES_OK : RES_ERROR;
 }
 
+static u32 disk_sector_count(void)
+{
+    const u8 *csd = card_info;
+
+    // CSD version 2.0 (SDHC/SDXC)
+    if ((csd[0] >> 6) == 1)
+    {
+        u32 c_size = ((csd[7] & 0x3f) << 16) | (csd[8] << 8) | csd[9];
+        return (c_size + 1) << 10;
+    }
+
+    // CSD version 1.0 (SDSC and MMC)
+    u32 read_bl_len = csd[5] & 0x0f;
+    u32 c_size = ((csd[6] & 0x03) << 10) | (csd[7] << 2) | (csd[8] >> 6);
+    u32 c_size_mult = ((csd[9] & 0x03) << 1) | (csd[10] >> 7);
+    return (c_size + 1) << (c_size_mult + 2 + read_bl_len - 9);
+}
+
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
 {
     if (dstatus & STA_NOINIT)
@@ -641,5 +659,11 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
         return RES_OK;
     }
 
+    if (cmd == GET_SECTOR_COUNT)
+    {
+        *(LBA_t *)buff = disk_sector_count();
+        return RES_OK;
+    }
+
     return RES_ERROR;
 }
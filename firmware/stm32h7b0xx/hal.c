@@ -27,12 +27,42 @@
 #include "usart.c"
 #include "flash.c"
 
+/******************************************************************************
+* Memory protection unit
+* TCM (crt_ram_buf, scratch_buf) is never cached by the L1 cache and is always
+* coherent. Default memory map is used for everything not covered below
+******************************************************************************/
+static void mpu_config(void)
+{
+    ARM_MPU_Disable();
+
+    // AXI SRAM (crt_buf): Read-mostly cartridge ROM and REU memory.
+    // Normal memory, write-back, read allocate only, so bulk memset/memcpy
+    // from the loader doesn't evict the hot banks. FORCEWT makes it
+    // write-through
+    ARM_MPU_SetRegion(ARM_MPU_RBAR(0, 0x24000000),
+                      ARM_MPU_RASR(1, ARM_MPU_AP_FULL, 0, 0, 1, 1, 0,
+                                   ARM_MPU_REGION_SIZE_1MB));
+
+    // AHB SRAM (dat_buf/KFF_BUF): Shared with the KFF bus handler and filled
+    // by the SD card and USB drivers. Normal memory, write-through, read
+    // allocate only
+    ARM_MPU_SetRegion(ARM_MPU_RBAR(1, 0x30000000),
+                      ARM_MPU_RASR(1, ARM_MPU_AP_FULL, 0, 0, 1, 0, 0,
+                                   ARM_MPU_REGION_SIZE_128KB));
+
+    // Use default memory map for privileged access to other regions
+    ARM_MPU_Enable(MPU_CTRL_PRIVDEFENA_Msk);
+}
+
 /******************************************************************************
 * Enable caches and the APB4 peripheral clock
 * Based on https://github.com/STMicroelectronics/stm32h7xx_hal_driver
 ******************************************************************************/
 static void sys_init(void)
 {
+    mpu_config();
+
     // Force write-through for all cacheable memory regions
     SCB->CACR = SCB_CACR_FORCEWT_Msk;
 
@@ -238,6 +268,7 @@ NO_RETURN system_restart(void)
     filesystem_unmount();
     led_off();
 
+    log_flush();
     usart_wait_for_tx();
 
     NVIC_SystemReset();
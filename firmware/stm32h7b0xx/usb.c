@@ -182,9 +182,14 @@ static const struct usb_string_descriptor *const dtable[] = {
 static usbd_device udev;
 static u32 ubuf[0x20];
 
-static u8 utx_fifo[0x200], urx_fifo[0x200];
-static volatile u32 utx_pos = 0, urx_pos = 0;
-static volatile bool utx_wait = false, urx_wait = false;
+// Single producer/consumer ring buffers. Size must be a power of 2
+#define USB_FIFO_SIZE   0x1000
+#define USB_FIFO_MASK   (USB_FIFO_SIZE - 1)
+
+// RX fifo has room for a packet past the end that is wrapped to the start
+static u8 utx_fifo[USB_FIFO_SIZE], urx_fifo[USB_FIFO_SIZE + CDC_DATA_SZ];
+static volatile u32 utx_head = 0, utx_tail = 0;
+static volatile u32 urx_head = 0, urx_tail = 0;
 
 static struct usb_cdc_line_coding cdc_line = {
     .dwDTERate          = 38400,
@@ -247,26 +252,24 @@ static usbd_respond cdc_control(usbd_device *dev, usbd_ctlreq *req, usbd_rqc_cal
 
 static inline bool usb_can_putc(void)
 {
-    return utx_pos < (sizeof(utx_fifo) - 1);
+    return (utx_head - utx_tail) < USB_FIFO_SIZE;
 }
 
 static void usb_putc(char ch)
 {
     // Wait for room in the fifo
-    while (utx_pos >= (sizeof(utx_fifo) - 1));
-
-    utx_wait = true;
-    __DSB();
+    while (!usb_can_putc());
 
-    utx_fifo[utx_pos++] = ch;
-    COMPILER_BARRIER();
+    u32 head = utx_head;
+    utx_fifo[head & USB_FIFO_MASK] = ch;
+    __DMB();
 
-    utx_wait = false;
+    utx_head = head + 1;
 }
 
 static inline bool usb_gotc(void)
 {
-    return urx_pos > 0;
+    return urx_head != urx_tail;
 }
 
 static char usb_getc(void)
@@ -274,46 +277,106 @@ static char usb_getc(void)
     // wait for data
     while (!usb_gotc());
 
-    urx_wait = true;
+    u32 tail = urx_tail;
+    char ch = urx_fifo[tail & USB_FIFO_MASK];
+    __DMB();
+
+    urx_tail = ++tail;
     __DSB();
 
-    char ch = urx_fifo[0];
-    memmove(&urx_fifo[0], &urx_fifo[1], --urx_pos);
-    COMPILER_BARRIER();
+    // Enable interrupt if room in buffer
+    if ((urx_head - tail) <= (USB_FIFO_SIZE - CDC_DATA_SZ))
+    {
+        _BST(OTG->GINTMSK, USB_OTG_GINTMSK_RXFLVLM);
+    }
+
+    return ch;
+}
+
+static inline u32 usb_rx_count(void)
+{
+    return urx_head - urx_tail;
+}
+
+static inline char usb_peekc(u32 offset)
+{
+    return urx_fifo[(urx_tail + offset) & USB_FIFO_MASK];
+}
+
+// Read up to size bytes without waiting. Returns number of bytes read
+static u32 usb_read(void *buf, u32 size)
+{
+    u32 tail = urx_tail;
+    u32 len = urx_head - tail;
+    if (len > size)
+    {
+        len = size;
+    }
 
-    urx_wait = false;
+    u32 pos = tail & USB_FIFO_MASK;
+    u32 first = USB_FIFO_SIZE - pos;
+    if (first > len)
+    {
+        first = len;
+    }
+
+    memcpy(buf, &urx_fifo[pos], first);
+    memcpy((u8 *)buf + first, &urx_fifo[0], len - first);
+    __DMB();
+
+    urx_tail = tail + len;
     __DSB();
 
     // Enable interrupt if room in buffer
-    if (urx_pos <= (sizeof(urx_fifo) - CDC_DATA_SZ))
+    if ((urx_head - urx_tail) <= (USB_FIFO_SIZE - CDC_DATA_SZ))
     {
         _BST(OTG->GINTMSK, USB_OTG_GINTMSK_RXFLVLM);
     }
 
-    return ch;
+    return len;
+}
+
+static void usb_wait_for_tx(void)
+{
+    // Give up if host isn't reading
+    for (u32 i=0; i<100 && utx_head != utx_tail; i++)
+    {
+        delay_ms(1);
+    }
 }
 
 /* CDC loop callback. Both for the Data IN and Data OUT endpoint */
 static void cdc_rx_tx(usbd_device *dev, u8 event, u8 ep) {
     if (event == usbd_evt_eptx) {
-        u32 pos = utx_pos;
-        u16 len = 0;
-        if (!utx_wait) {
-            len = (pos < CDC_DATA_SZ) ? pos : CDC_DATA_SZ;
+        u32 tail = utx_tail;
+        u32 pos = tail & USB_FIFO_MASK;
+        u32 len = utx_head - tail;
+
+        // Send up to a packet without wrapping around the end of the fifo
+        if (len > CDC_DATA_SZ) {
+            len = CDC_DATA_SZ;
+        }
+        if (len > USB_FIFO_SIZE - pos) {
+            len = USB_FIFO_SIZE - pos;
         }
 
-        s32 _t = usbd_ep_write(dev, ep, &utx_fifo[0], len);
+        s32 _t = usbd_ep_write(dev, ep, &utx_fifo[pos], len);
         if (_t > 0) {
-            pos -= _t;
-            memmove(&utx_fifo[0], &utx_fifo[_t], pos);
-            utx_pos = pos;
+            utx_tail = tail + _t;
         }
     } else {
-        u32 pos = urx_pos;
-        if (!urx_wait && pos <= (sizeof(urx_fifo) - CDC_DATA_SZ)) {
+        u32 head = urx_head;
+        if ((head - urx_tail) <= (USB_FIFO_SIZE - CDC_DATA_SZ)) {
+            u32 pos = head & USB_FIFO_MASK;
             s32 _t = usbd_ep_read(dev, ep, &urx_fifo[pos], CDC_DATA_SZ);
             if (_t > 0) {
-                urx_pos = pos + _t;
+                // Move data received past the end to the start of the fifo
+                if (pos + _t > USB_FIFO_SIZE) {
+                    memcpy(&urx_fifo[0], &urx_fifo[USB_FIFO_SIZE],
+                           pos + _t - USB_FIFO_SIZE);
+                }
+                __DMB();
+                urx_head = head + _t;
             }
         } else {
             // Disable interrupt otherwise we will be called again immediately,
@@ -404,3 +467,5 @@ static void usb_config(void)
     usbd_enable(&udev, true);
     usbd_connect(&udev, true);
 }
+
+#include "usb_msc.c"
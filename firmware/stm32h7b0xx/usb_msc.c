@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2019-2025 Kim Jørgensen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************
+ * USB Mass Storage Class (Bulk-Only Transport) exposing the SD card
+ */
+
+#define MSC_RXD_EP      0x01
+#define MSC_TXD_EP      0x81
+#define MSC_DATA_SZ     0x40
+
+#define MSC_CBW_SIGNATURE   0x43425355
+#define MSC_CSW_SIGNATURE   0x53425355
+
+#define MSC_REQ_RESET       0xff
+#define MSC_REQ_GET_MAX_LUN 0xfe
+
+// Sectors are transferred via the data buffer
+#define MSC_BUF         (dat_buf)
+#define MSC_BUF_SECTORS (sizeof(dat_buf) / 512)
+
+typedef enum
+{
+    MSC_STATE_CBW = 0x00,   // Waiting for command block wrapper
+    MSC_STATE_DATA_IN,      // Sending response from buffer
+    MSC_STATE_READ,         // Sending sectors read from SD card
+    MSC_STATE_WRITE,        // Receiving sectors to write to SD card
+    MSC_STATE_STALL,        // Waiting for host to clear endpoint halt
+    MSC_STATE_CSW           // Sending command status wrapper
+} MSC_STATE;
+
+typedef enum
+{
+    MSC_CSW_PASSED  = 0x00,
+    MSC_CSW_FAILED  = 0x01
+} MSC_CSW_STATUS;
+
+typedef enum
+{
+    SCSI_TEST_UNIT_READY        = 0x00,
+    SCSI_REQUEST_SENSE          = 0x03,
+    SCSI_INQUIRY                = 0x12,
+    SCSI_MODE_SENSE_6           = 0x1a,
+    SCSI_START_STOP_UNIT        = 0x1b,
+    SCSI_ALLOW_MEDIUM_REMOVAL   = 0x1e,
+    SCSI_READ_FORMAT_CAPACITIES = 0x23,
+    SCSI_READ_CAPACITY_10       = 0x25,
+    SCSI_READ_10                = 0x28,
+    SCSI_WRITE_10               = 0x2a,
+    SCSI_VERIFY_10              = 0x2f,
+    SCSI_SYNCHRONIZE_CACHE_10   = 0x35,
+    SCSI_MODE_SENSE_10          = 0x5a
+} SCSI_COMMAND;
+
+// Sense key and additional sense code
+#define SCSI_SENSE_NONE             0x0000
+#define SCSI_SENSE_MEDIUM_ERROR     0x0300
+#define SCSI_SENSE_INVALID_COMMAND  0x0520
+#define SCSI_SENSE_LBA_OUT_OF_RANGE 0x0521
+#define SCSI_SENSE_INVALID_FIELD    0x0524
+
+typedef struct
+{
+    u32 signature;
+    u32 tag;
+    u32 data_len;
+    u8 flags;
+    u8 lun;
+    u8 cb_len;
+    u8 cb[16];
+} __attribute__((packed)) MSC_CBW;
+
+typedef struct
+{
+    u32 signature;
+    u32 tag;
+    u32 residue;
+    u8 status;
+} __attribute__((packed)) MSC_CSW;
+
+typedef struct
+{
+    u8 state;
+    u8 stall_ep;
+    u16 sense;
+
+    MSC_CBW cbw;
+    MSC_CSW csw;
+
+    u8 *data_ptr;
+    u32 data_len;   // Bytes left in buffer
+
+    u32 lba;
+    u32 blocks;     // Sectors left to transfer
+    u32 sector_count;
+} MSC_STATE_DATA;
+
+static MSC_STATE_DATA msc;
+static u8 msc_max_lun;
+
+struct msc_config {
+    struct usb_config_descriptor        config;
+    struct usb_interface_descriptor     data;
+    struct usb_endpoint_descriptor      data_eprx;
+    struct usb_endpoint_descriptor      data_eptx;
+} __attribute__((packed));
+
+static const struct usb_device_descriptor msc_device_desc = {
+    .bLength            = sizeof(struct usb_device_descriptor),
+    .bDescriptorType    = USB_DTYPE_DEVICE,
+    .bcdUSB             = VERSION_BCD(2,0,0),
+    .bDeviceClass       = USB_CLASS_PER_INTERFACE,
+    .bDeviceSubClass    = USB_SUBCLASS_NONE,
+    .bDeviceProtocol    = USB_PROTO_NONE,
+    .bMaxPacketSize0    = CDC_EP0_SIZE,
+    .idVendor           = 0x0483,
+    .idProduct          = 0x5720,
+    .bcdDevice          = VERSION_BCD(1,0,0),
+    .iManufacturer      = 1,
+    .iProduct           = 2,
+    .iSerialNumber      = INTSERIALNO_DESCRIPTOR,
+    .bNumConfigurations = 1,
+};
+
+static const struct msc_config msc_config_desc = {
+    .config = {
+        .bLength                = sizeof(struct usb_config_descriptor),
+        .bDescriptorType        = USB_DTYPE_CONFIGURATION,
+        .wTotalLength           = sizeof(struct msc_config),
+        .bNumInterfaces         = 1,
+        .bConfigurationValue    = 1,
+        .iConfiguration         = NO_DESCRIPTOR,
+        .bmAttributes           = USB_CFG_ATTR_RESERVED | USB_CFG_ATTR_SELFPOWERED,
+        .bMaxPower              = USB_CFG_POWER_MA(100),
+    },
+    .data = {
+        .bLength                = sizeof(struct usb_interface_descriptor),
+        .bDescriptorType        = USB_DTYPE_INTERFACE,
+        .bInterfaceNumber       = 0,
+        .bAlternateSetting      = 0,
+        .bNumEndpoints          = 2,
+        .bInterfaceClass        = USB_CLASS_MASS_STORAGE,
+        .bInterfaceSubClass     = 0x06,     // SCSI transparent command set
+        .bInterfaceProtocol     = 0x50,     // Bulk-only transport
+        .iInterface             = NO_DESCRIPTOR,
+    },
+    .data_eprx = {
+        .bLength                = sizeof(struct usb_endpoint_descriptor),
+        .bDescriptorType        = USB_DTYPE_ENDPOINT,
+        .bEndpointAddress       = MSC_RXD_EP,
+        .bmAttributes           = USB_EPTYPE_BULK,
+        .wMaxPacketSize         = MSC_DATA_SZ,
+        .bInterval              = 0x00,
+    },
+    .data_eptx = {
+        .bLength                = sizeof(struct usb_endpoint_descriptor),
+        .bDescriptorType        = USB_DTYPE_ENDPOINT,
+        .bEndpointAddress       = MSC_TXD_EP,
+        .bmAttributes           = USB_EPTYPE_BULK,
+        .wMaxPacketSize         = MSC_DATA_SZ,
+        .bInterval              = 0x00,
+    }
+};
+
+static const u8 msc_inquiry[36] = {
+    0x00,   // Direct access block device
+    0x80,   // Removable medium
+    0x04,   // SPC-2
+    0x02,   // Response data format
+    31,     // Additional length
+    0x00, 0x00, 0x00,
+    'K', 'T', 'H', ' ', ' ', ' ', ' ', ' ',
+    'K', 'u', 'n', 'g', ' ', 'F', 'u', ' ',
+    'F', 'l', 'a', 's', 'h', ' ', '2', ' ',
+    '1', '.', '0', '0'
+};
+
+static usbd_respond msc_getdesc(usbd_ctlreq *req, void **address, u16 *length) {
+    const u8 dtype = req->wValue >> 8;
+    const u8 dnumber = req->wValue & 0xFF;
+    const void* desc;
+    u16 len = 0;
+    switch (dtype) {
+    case USB_DTYPE_DEVICE:
+        desc = &msc_device_desc;
+        break;
+    case USB_DTYPE_CONFIGURATION:
+        desc = &msc_config_desc;
+        len = sizeof(msc_config_desc);
+        break;
+    case USB_DTYPE_STRING:
+        if (dnumber < 3) {
+            desc = dtable[dnumber];
+        } else {
+            return usbd_fail;
+        }
+        break;
+    default:
+        return usbd_fail;
+    }
+    if (len == 0) {
+        len = ((struct usb_header_descriptor*)desc)->bLength;
+    }
+    *address = (void*)desc;
+    *length = len;
+    return usbd_ack;
+}
+
+static usbd_respond msc_control(usbd_device *dev, usbd_ctlreq *req, usbd_rqc_callback *callback) {
+    if (((USB_REQ_RECIPIENT | USB_REQ_TYPE) & req->bmRequestType) == (USB_REQ_INTERFACE | USB_REQ_CLASS)
+        && req->wIndex == 0 ) {
+        switch (req->bRequest) {
+        case MSC_REQ_RESET:
+            msc.state = MSC_STATE_CBW;
+            return usbd_ack;
+        case MSC_REQ_GET_MAX_LUN:
+            dev->status.data_ptr = &msc_max_lun;
+            dev->status.data_count = sizeof(msc_max_lun);
+            return usbd_ack;
+        default:
+            return usbd_fail;
+        }
+    }
+
+    return usbd_fail;
+}
+
+/******************************************************************************
+* Bulk-only transport
+******************************************************************************/
+static void msc_send_csw(usbd_device *dev, u8 status)
+{
+    msc.csw.signature = MSC_CSW_SIGNATURE;
+    msc.csw.tag = msc.cbw.tag;
+    msc.csw.status = status;
+
+    msc.state = MSC_STATE_CSW;
+    usbd_ep_write(dev, MSC_TXD_EP, &msc.csw, sizeof(msc.csw));
+}
+
+static void msc_fail(usbd_device *dev, u16 sense)
+{
+    msc.sense = sense;
+    msc.csw.status = MSC_CSW_FAILED;
+
+    // Stall the data stage. CSW is sent once the host has cleared the halt
+    if (msc.cbw.data_len)
+    {
+        msc.stall_ep = (msc.cbw.flags & 0x80) ? MSC_TXD_EP : MSC_RXD_EP;
+        msc.state = MSC_STATE_STALL;
+        usbd_ep_stall(dev, msc.stall_ep);
+        return;
+    }
+
+    msc_send_csw(dev, MSC_CSW_FAILED);
+}
+
+static void msc_send_packet(usbd_device *dev)
+{
+    u32 len = msc.data_len < MSC_DATA_SZ ? msc.data_len : MSC_DATA_SZ;
+    s32 sent = usbd_ep_write(dev, MSC_TXD_EP, msc.data_ptr, len);
+    if (sent > 0)
+    {
+        msc.data_ptr += sent;
+        msc.data_len -= sent;
+        msc.csw.residue -= sent;
+    }
+}
+
+static void msc_send_data(usbd_device *dev, const void *data, u32 len)
+{
+    if (len > msc.cbw.data_len)
+    {
+        len = msc.cbw.data_len;
+    }
+
+    memcpy(MSC_BUF, data, len);
+    msc.data_ptr = MSC_BUF;
+    msc.data_len = len;
+    msc.state = MSC_STATE_DATA_IN;
+    msc_send_packet(dev);
+}
+
+static bool msc_read_sectors(void)
+{
+    u32 count = msc.blocks < MSC_BUF_SECTORS ? msc.blocks : MSC_BUF_SECTORS;
+    if (disk_read(0, MSC_BUF, msc.lba, count) != RES_OK)
+    {
+        return false;
+    }
+
+    msc.lba += count;
+    msc.blocks -= count;
+    msc.data_ptr = MSC_BUF;
+    msc.data_len = count * 512;
+    return true;
+}
+
+static void msc_receive_sectors(void)
+{
+    u32 count = msc.blocks < MSC_BUF_SECTORS ? msc.blocks : MSC_BUF_SECTORS;
+    msc.data_ptr = MSC_BUF;
+    msc.data_len = count * 512;
+}
+
+static bool msc_write_sectors(void)
+{
+    u32 count = (msc.data_ptr - MSC_BUF) / 512;
+    if (disk_write(0, MSC_BUF, msc.lba, count) != RES_OK)
+    {
+        return false;
+    }
+
+    msc.lba += count;
+    msc.blocks -= count;
+    return true;
+}
+
+static bool msc_parse_rw10(void)
+{
+    const u8 *cb = msc.cbw.cb;
+    msc.lba = (cb[2] << 24) | (cb[3] << 16) | (cb[4] << 8) | cb[5];
+    msc.blocks = (cb[7] << 8) | cb[8];
+
+    return msc.lba < msc.sector_count &&
+           msc.blocks <= msc.sector_count - msc.lba &&
+           msc.blocks * 512 <= msc.cbw.data_len;
+}
+
+static void msc_handle_command(usbd_device *dev)
+{
+    u8 *buf = (u8 *)scratch_buf;
+    msc.csw.residue = msc.cbw.data_len;
+    msc.csw.status = MSC_CSW_PASSED;
+
+    switch (msc.cbw.cb[0])
+    {
+        case SCSI_TEST_UNIT_READY:
+        case SCSI_START_STOP_UNIT:
+        case SCSI_ALLOW_MEDIUM_REMOVAL:
+        case SCSI_VERIFY_10:
+        case SCSI_SYNCHRONIZE_CACHE_10:
+        {
+            if (msc.cbw.data_len)
+            {
+                msc_fail(dev, SCSI_SENSE_INVALID_FIELD);
+                break;
+            }
+
+            msc.sense = SCSI_SENSE_NONE;
+            msc_send_csw(dev, MSC_CSW_PASSED);
+        }
+        break;
+
+        case SCSI_REQUEST_SENSE:
+        {
+            memset(buf, 0, 18);
+            buf[0] = 0x70;  // Current errors
+            buf[2] = msc.sense >> 8;
+            buf[7] = 10;    // Additional length
+            buf[12] = msc.sense & 0xff;
+
+            msc.sense = SCSI_SENSE_NONE;
+            msc_send_data(dev, buf, 18);
+        }
+        break;
+
+        case SCSI_INQUIRY:
+        {
+            msc_send_data(dev, msc_inquiry, sizeof(msc_inquiry));
+        }
+        break;
+
+        case SCSI_MODE_SENSE_6:
+        {
+            memset(buf, 0, 4);
+            buf[0] = 3;     // Mode data length
+            msc_send_data(dev, buf, 4);
+        }
+        break;
+
+        case SCSI_MODE_SENSE_10:
+        {
+            memset(buf, 0, 8);
+            buf[1] = 6;     // Mode data length
+            msc_send_data(dev, buf, 8);
+        }
+        break;
+
+        case SCSI_READ_FORMAT_CAPACITIES:
+        {
+            u32 count = msc.sector_count;
+            memset(buf, 0, 12);
+            buf[3] = 8;     // Capacity list length
+            buf[4] = count >> 24;
+            buf[5] = count >> 16;
+            buf[6] = count >> 8;
+            buf[7] = count;
+            buf[8] = 0x02;  // Formatted media
+            buf[10] = 512 >> 8;
+            msc_send_data(dev, buf, 12);
+        }
+        break;
+
+        case SCSI_READ_CAPACITY_10:
+        {
+            u32 last = msc.sector_count - 1;
+            memset(buf, 0, 8);
+            buf[0] = last >> 24;
+            buf[1] = last >> 16;
+            buf[2] = last >> 8;
+            buf[3] = last;
+            buf[6] = 512 >> 8;
+            msc_send_data(dev, buf, 8);
+        }
+        break;
+
+        case SCSI_READ_10:
+        {
+            if (!msc_parse_rw10() || !(msc.cbw.flags & 0x80))
+            {
+                msc_fail(dev, SCSI_SENSE_LBA_OUT_OF_RANGE);
+                break;
+            }
+
+            if (!msc.blocks)
+            {
+                msc_send_csw(dev, MSC_CSW_PASSED);
+                break;
+            }
+
+            if (!msc_read_sectors())
+            {
+                msc_fail(dev, SCSI_SENSE_MEDIUM_ERROR);
+                break;
+            }
+
+            msc.state = MSC_STATE_READ;
+            msc_send_packet(dev);
+        }
+        break;
+
+        case SCSI_WRITE_10:
+        {
+            if (!msc_parse_rw10() || (msc.cbw.flags & 0x80))
+            {
+                msc_fail(dev, SCSI_SENSE_LBA_OUT_OF_RANGE);
+                break;
+            }
+
+            if (!msc.blocks)
+            {
+                msc_send_csw(dev, MSC_CSW_PASSED);
+                break;
+            }
+
+            msc_receive_sectors();
+            msc.state = MSC_STATE_WRITE;
+        }
+        break;
+
+        default:
+        {
+            dbg("Unsupported SCSI command: %x", msc.cbw.cb[0]);
+            msc_fail(dev, SCSI_SENSE_INVALID_COMMAND);
+        }
+        break;
+    }
+}
+
+static void msc_rx(usbd_device *dev)
+{
+    if (msc.state == MSC_STATE_CBW)
+    {
+        s32 len = usbd_ep_read(dev, MSC_RXD_EP, &msc.cbw, sizeof(msc.cbw));
+        if (len != sizeof(msc.cbw) || msc.cbw.signature != MSC_CBW_SIGNATURE)
+        {
+            wrn("Invalid CBW received");
+            return;
+        }
+
+        msc_handle_command(dev);
+    }
+    else if (msc.state == MSC_STATE_WRITE)
+    {
+        s32 len = usbd_ep_read(dev, MSC_RXD_EP, msc.data_ptr, msc.data_len);
+        if (len <= 0)
+        {
+            return;
+        }
+
+        msc.data_ptr += len;
+        msc.data_len -= len;
+        msc.csw.residue -= len;
+        if (msc.data_len)
+        {
+            return;
+        }
+
+        if (!msc_write_sectors())
+        {
+            msc.sense = SCSI_SENSE_MEDIUM_ERROR;
+            msc_send_csw(dev, MSC_CSW_FAILED);
+        }
+        else if (msc.blocks)
+        {
+            msc_receive_sectors();
+        }
+        else
+        {
+            msc_send_csw(dev, MSC_CSW_PASSED);
+        }
+    }
+    // Leave the packet in the RX FIFO until we are ready for it
+}
+
+static void msc_tx(usbd_device *dev)
+{
+    switch (msc.state)
+    {
+        case MSC_STATE_DATA_IN:
+        {
+            if (msc.data_len)
+            {
+                msc_send_packet(dev);
+            }
+            else
+            {
+                msc_send_csw(dev, msc.csw.status);
+            }
+        }
+        break;
+
+        case MSC_STATE_READ:
+        {
+            if (!msc.data_len)
+            {
+                if (!msc.blocks)
+                {
+                    msc_send_csw(dev, MSC_CSW_PASSED);
+                    break;
+                }
+
+                if (!msc_read_sectors())
+                {
+                    msc.sense = SCSI_SENSE_MEDIUM_ERROR;
+                    msc_send_csw(dev, MSC_CSW_FAILED);
+                    break;
+                }
+            }
+
+            msc_send_packet(dev);
+        }
+        break;
+
+        case MSC_STATE_CSW:
+        {
+            msc.state = MSC_STATE_CBW;
+        }
+        break;
+    }
+}
+
+static void msc_rx_tx(usbd_device *dev, u8 event, u8 ep)
+{
+    if (event == usbd_evt_eptx)
+    {
+        msc_tx(dev);
+    }
+    else
+    {
+        msc_rx(dev);
+    }
+}
+
+static usbd_respond msc_setconf(usbd_device *dev, u8 cfg) {
+    switch (cfg) {
+    case 0:
+        /* deconfiguring device */
+        usbd_ep_deconfig(dev, MSC_TXD_EP);
+        usbd_ep_deconfig(dev, MSC_RXD_EP);
+        usbd_reg_endpoint(dev, MSC_RXD_EP, 0);
+        usbd_reg_endpoint(dev, MSC_TXD_EP, 0);
+        return usbd_ack;
+    case 1:
+        /* configuring device */
+        usbd_ep_config(dev, MSC_RXD_EP, USB_EPTYPE_BULK, MSC_DATA_SZ);
+        usbd_ep_config(dev, MSC_TXD_EP, USB_EPTYPE_BULK, MSC_DATA_SZ);
+        usbd_reg_endpoint(dev, MSC_RXD_EP, msc_rx_tx);
+        usbd_reg_endpoint(dev, MSC_TXD_EP, msc_rx_tx);
+        msc.state = MSC_STATE_CBW;
+        return usbd_ack;
+    default:
+        return usbd_fail;
+    }
+}
+
+/******************************************************************************
+* Expose the SD card as USB mass storage until the menu button is pressed.
+* The filesystem must be unmounted and the C64 interface disabled
+******************************************************************************/
+static void usb_msc_loop(void)
+{
+    u32 sector_count;
+    if (disk_ioctl(0, GET_SECTOR_COUNT, &sector_count) != RES_OK)
+    {
+        err("Failed to get SD card size");
+        return;
+    }
+
+    // USB is polled from here to allow SD card access from the callbacks
+    NVIC_DisableIRQ(OTG_HS_IRQn);
+    usbd_connect(&udev, false);
+    delay_ms(100);  // Let the host see the disconnect
+
+    memset(&msc, 0, sizeof(msc));
+    msc.sector_count = sector_count;
+    usbd_reg_config(&udev, msc_setconf);
+    usbd_reg_control(&udev, msc_control);
+    usbd_reg_descr(&udev, msc_getdesc);
+    usbd_connect(&udev, true);
+
+    while (!menu_button_pressed())
+    {
+        usbd_poll(&udev);
+
+        // Send CSW when the host has cleared the endpoint halt
+        if (msc.state == MSC_STATE_STALL &&
+            !udev.driver->ep_isstalled(msc.stall_ep))
+        {
+            msc_send_csw(&udev, msc.csw.status);
+        }
+    }
+
+    usbd_connect(&udev, false);
+}
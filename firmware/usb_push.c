@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2019-2025 Kim Jørgensen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************
+ * Push a CRT, PRG or disk image from USB directly to the firmware and run it.
+ *
+ * Host sends:  "KFFPUSH:" + type (4 bytes, e.g. "CRT\0") + size (u32 LE)
+ * Reply:       "LOAD\0" if accepted, otherwise "FAIL\0"
+ * Host sends:  image (size bytes)
+ * Reply:       "DONE\0" and the image is started, otherwise "FAIL\0"
+ */
+
+#define USB_PUSH_SIGNATURE  "KFFPUSH:"
+#define USB_PUSH_HDR_SIZE   (8+4+4)
+#define USB_PUSH_PATH       "/"
+#define USB_PUSH_NAME       "KFF-USB."
+
+static void usb_push_reply(const char *reply)
+{
+    for (u8 i=0; i<5; i++)
+    {
+        usb_putc(reply[i]);
+    }
+
+    usb_wait_for_tx();
+}
+
+// Receive until size bytes or 2 seconds without data
+static u32 usb_push_receive(void *buf, u32 size)
+{
+    u8 *buf_ptr = (u8 *)buf;
+    u32 received = 0;
+    u8 timeouts = 0;
+
+    timer_start_ms(250);
+    while (received < size && timeouts < 8)
+    {
+        u32 len = usb_read(buf_ptr + received, size - received);
+        if (len)
+        {
+            received += len;
+            timeouts = 0;
+            timer_reset();
+        }
+        else if (timer_elapsed())
+        {
+            timeouts++;
+        }
+    }
+
+    return received;
+}
+
+// crt_read_func with the number of bytes left as source
+static u32 usb_push_read(void *source, void *buf, u32 size)
+{
+    u32 *bytes_left = (u32 *)source;
+    if (size > *bytes_left)
+    {
+        size = *bytes_left;
+    }
+
+    u32 len = usb_push_receive(buf, size);
+    *bytes_left -= len;
+    return len;
+}
+
+static bool usb_push_detect(void)
+{
+    // Other data (like the EF3 USB protocol) is left in the USB fifo
+    if (usb_peekc(0) != USB_PUSH_SIGNATURE[0])
+    {
+        return false;
+    }
+
+    timer_start_ms(250);
+    while (usb_rx_count() < USB_PUSH_HDR_SIZE)
+    {
+        if (timer_elapsed())
+        {
+            return false;
+        }
+    }
+
+    for (u8 i=1; i<sizeof(USB_PUSH_SIGNATURE)-1; i++)
+    {
+        if (usb_peekc(i) != USB_PUSH_SIGNATURE[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool usb_push_crt(u32 size)
+{
+    CRT_HEADER header;
+    if (!crt_read_header(usb_push_read, &size, &header) ||
+        !crt_is_supported(header.cartridge_type))
+    {
+        return false;
+    }
+
+    crt_buf_invalidate();
+    u8 banks = crt_read_chips(usb_push_read, &size, header.cartridge_type);
+    if (!banks || size)
+    {
+        wrn("Incomplete CRT push (%u bytes missing)", size);
+        return false;
+    }
+    crt_install_eapi(header.cartridge_type);
+
+    crt_buf_valid(banks);
+    cfg_file.crt.type = header.cartridge_type;
+    cfg_file.crt.hw_rev = header.hardware_revision;
+    cfg_file.crt.exrom = header.exrom;
+    cfg_file.crt.game = header.game;
+    cfg_file.crt.flags = CRT_FLAG_NONE;
+    cfg_file.boot_type = CFG_CRT;
+
+    // The CRT only exists in memory. Name it after the push so the saved
+    // config matches crt_buf after a restart and an updated EasyFlash CRT
+    // isn't saved over the last file selected from the SD card
+    strcpy(cfg_file.path, USB_PUSH_PATH);
+    strcpy(cfg_file.file, USB_PUSH_NAME "crt");
+    save_cfg();
+    return true;
+}
+
+static bool usb_push_prg(u32 size)
+{
+    if (size > sizeof(dat_buf) || !prg_size_valid(size) ||
+        usb_push_receive(dat_buf, size) != size)
+    {
+        return false;
+    }
+
+    usb_push_prg_size = size;
+    cfg_file.img.mode = PRG_MODE_USB;
+    cfg_file.boot_type = CFG_PRG;
+    return true;
+}
+
+static bool usb_push_disk(u32 size)
+{
+    // Use the image type given by the size (not the one sent by the host)
+    const char *extension;
+    switch (d64_get_type(size))
+    {
+        case D64_TYPE_D64:
+            extension = "D64";
+            break;
+
+        case D64_TYPE_D71:
+            extension = "D71";
+            break;
+
+        case D64_TYPE_D81:
+            extension = "D81";
+            break;
+
+        default:
+            return false;
+    }
+
+    if (!dir_change(USB_PUSH_PATH))
+    {
+        return false;
+    }
+
+    sprint(cfg_file.file, USB_PUSH_NAME "%s", extension);
+
+    FIL file;
+    if (!file_open(&file, cfg_file.file, FA_WRITE|FA_CREATE_ALWAYS))
+    {
+        return false;
+    }
+
+    // Disk images are accessed from the SD card in disk mode
+    bool result = true;
+    while (size && result)
+    {
+        u32 len = usb_push_read(&size, dat_buf, sizeof(dat_buf));
+        result = len && file_write(&file, dat_buf, len) == len;
+    }
+    result &= file_close(&file);
+
+    strcpy(cfg_file.path, USB_PUSH_PATH);
+    cfg_file.img.mode = DISK_MODE_D64;
+    cfg_file.img.element = 1;   // LOAD"*",8,1
+    cfg_file.boot_type = CFG_DISK;
+    return result;
+}
+
+// Returns false if USB data isn't a push command
+static bool usb_push_load(void)
+{
+    if (!usb_push_detect())
+    {
+        return false;
+    }
+
+    u8 header[USB_PUSH_HDR_SIZE];
+    usb_read(header, sizeof(header));
+
+    char type[4];
+    memcpy(type, header + 8, sizeof(type));
+    type[3] = 0;
+
+    u32 size;
+    memcpy(&size, header + 12, sizeof(size));
+    dbg("Got USB push of %s. Size: %u bytes", type, size);
+
+    bool result = false;
+    if (strcmp(type, "CRT") == 0)
+    {
+        usb_push_reply("LOAD");
+        result = usb_push_crt(size);
+    }
+    else if (strcmp(type, "PRG") == 0)
+    {
+        usb_push_reply("LOAD");
+        result = usb_push_prg(size);
+    }
+    else if (strcmp(type, "D64") == 0 || strcmp(type, "D71") == 0 ||
+             strcmp(type, "D81") == 0)
+    {
+        usb_push_reply("LOAD");
+        result = usb_push_disk(size);
+    }
+
+    if (!result)
+    {
+        wrn("USB push failed");
+        usb_push_reply("FAIL");
+        restart_to_menu();
+    }
+
+    usb_push_reply("DONE");
+    return true;
+}
@@ -29,6 +29,7 @@
 .export init_system
 
 .import _main
+.import snapshot_nmi
 
 .import initlib, donelib, copydata
 .import zerobss
@@ -189,7 +190,7 @@ dummy_vector:
 .endproc
 
         .segment "VECTORS"
-.word   dummy_vector    ; NMI vector
+.word   snapshot_nmi    ; NMI vector
 reset_vector:
 .word   ultimax_reset   ; Reset vector
 .word   dummy_vector    ; IRQ/BRK vector
@@ -89,6 +89,7 @@ QTSW            = $d4                   ; Quotation mode flag
 ERROR_FILE_NOT_FOUND    = $04
 
 ; Kernal status codes
+STATUS_VERIFY_ERROR     = $10
 STATUS_END_OF_FILE      = $40
 STATUS_READ_ERROR       = $42
 STATUS_SAVE_FILE_EXISTS = $80
@@ -100,7 +101,9 @@ KFF_SAVE_RAM_SIZE       = 22
 KFF_DATA                = $de00
 KFF_COMMAND             = $de01
 KFF_CONTROL             = $de02
+KFF_LOAD_PAGES          = $de02         ; Read: PRG pages ready, $ff when all
 KFF_RAM_TST             = $de03
+KFF_READ_HPTR           = $de05
 KFF_WRITE_LPTR          = $de06
 KFF_WRITE_HPTR          = $de07
 KFF_RAM                 = $de08
@@ -108,12 +111,14 @@ KFF_RAM                 = $de08
 KFF_RAM_SIZE            = $00f8
 KFF_KILL                = $00
 KFF_ENABLE              = $01
+KFF_ULTIMAX             = $40
 
 ; Align with commands.h
 CMD_NO_DRIVE            = $10
 CMD_DISK_ERROR          = $11
 CMD_NOT_FOUND           = $12
 CMD_END_OF_FILE         = $13
+CMD_VERIFY_ERROR        = $14
 CMD_WAIT_SYNC           = $50
 CMD_SYNC                = $55
 
@@ -128,6 +133,7 @@ REPLY_SEND_BYTE         = $96
 REPLY_LISTEN            = $97
 REPLY_UNLISTEN          = $98
 REPLY_RECEIVE_BYTE      = $99
+REPLY_VERIFY            = $9b
 
 ; =============================================================================
 VECTOR_PAGE     = IOPEN & $ff00
@@ -777,9 +783,6 @@ kff_load:
         lda FNLEN
         beq @no_filename                ; No filename, load will report error
 
-        lda VERCK
-        bne @not_found                  ; TODO: Support verify operation
-
         lda #REPLY_LOAD                 ; Send reply
         jsr kff_send_reply
         beq @load_ok
@@ -843,6 +846,9 @@ kff_load:
 
 @load_start:
         ldy #$00
+        lda VERCK
+        bne @verify                     ; Compare with memory instead
+
         ldx tmp2
         beq @load_rest
         bne @new_page
@@ -860,6 +866,10 @@ kff_load:
         dex
         beq @load_rest
 @new_page:
+        lda KFF_READ_HPTR               ; Wait for the page to be read
+        cmp KFF_LOAD_PAGES
+        bcs @new_page
+
         lda EAH                         ; Check for load to I/O area
         cmp #$cf
         bcc @load_256_bytes
@@ -882,6 +892,10 @@ kff_load:
 @load_rest:
         ldx tmp1
         beq @load_end
+@wait_rest:
+        ldx KFF_LOAD_PAGES              ; Wait for the rest to be read
+        inx
+        bne @wait_rest
         ldx #$33
 @load_bytes:
         lda KFF_DATA                    ; Receive the remaining bytes
@@ -892,6 +906,38 @@ kff_load:
         iny
         dec tmp1
         bne @load_bytes
+        beq @load_end
+
+@verify:
+        ldx KFF_LOAD_PAGES              ; Wait for the whole file to be read
+        inx
+        bne @verify
+
+        lda EAL                         ; Send start address and size
+        sta KFF_DATA
+        lda EAH
+        sta KFF_DATA
+        lda tmp1
+        sta KFF_DATA
+        lda tmp2
+        sta KFF_DATA
+
+        jsr kff_verify                  ; Let the firmware compare
+        cmp #CMD_VERIFY_ERROR
+        bne @verify_end
+
+        lda #STATUS_VERIFY_ERROR        ; Flag verify error
+        ora STATUS
+        sta STATUS
+@verify_end:
+        clc                             ; End address is start + size
+        lda EAL
+        adc tmp1
+        sta EAL
+        lda EAH
+        adc tmp2
+        sta EAH
+        ldy #$00
 @load_end:
         sty tmp1
         jsr install_disk_vectors        ; Reinstall vectors if changed
@@ -911,6 +957,38 @@ kff_load:
         jmp disable_kff_rom
 .endproc
 
+; =============================================================================
+;
+; Wait while the firmware compares the file with C64 RAM using DMA. RAM must
+; be visible in all areas, so the C64 waits in Ultimax mode with $01 set to
+; $34. Placed at ROML as this is visible in both 16k and Ultimax mode.
+; Returns the command from the firmware in A.
+;
+; =============================================================================
+.segment "LOWCODE"
+.proc kff_verify
+kff_verify:
+        lda #KFF_ULTIMAX
+        sta KFF_CONTROL
+        lda R6510                       ; Make all RAM visible for DMA
+        pha
+        lda #$34
+        sta R6510
+
+        lda #REPLY_VERIFY               ; Send reply
+        sta KFF_COMMAND
+:       cmp KFF_COMMAND
+        beq :-                          ; Wait for the firmware
+
+        pla                             ; Restore mem config
+        sta R6510
+        lda #KFF_ENABLE
+        sta KFF_CONTROL
+        lda KFF_COMMAND                 ; Get command
+        rts
+.endproc
+.code
+
 ; =============================================================================
 .proc kff_save
 kff_save:
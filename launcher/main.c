@@ -45,6 +45,7 @@
 #include "kff_data.h"
 #include "ef3usb_loader.h"
 #include "disk.h"
+#include "snapshot.h"
 #include "launcher_asm.h"
 
 /* declarations */
@@ -76,7 +77,7 @@ static char inputBuffer[SEARCH_LENGTH+1];
 static char searchBuffer[SEARCH_LENGTH+1];
 static uint8_t searchLen = 0;
 static uint8_t *bigBuffer = NULL;
-static uint16_t *pageBuffer = NULL;
+static uint16_t textPage, textLength;
 static Directory *dir = NULL;
 
 #define KUNG_FU_FLASH_VER "Kung Fu Flash v" ## KFF_VER
@@ -97,7 +98,6 @@ int main(void)
 
     dir = (Directory *)malloc(sizeof(Directory));
     bigBuffer = (uint8_t *)dir;
-    pageBuffer = (uint16_t *)dir;
 
     if (dir == NULL)
     {
@@ -250,6 +250,10 @@ static void mainLoopKFF(void)
                 wait_for_reset();
                 break;
 
+            case CMD_SNAPSHOT:
+                snapshot_restore();
+                break;
+
             default:
                 showMessage("Communication with cartridge failed.", ERRORC);
                 cprintf("Unexpected command: %x", cmd);
@@ -276,15 +280,22 @@ static void showKFFMessage(uint8_t color)
     showMessage(text, color);
 }
 
-static void showTextPage(uint16_t page)
+// Returns true if there is more text after the page
+static bool showTextPage(uint16_t page)
 {
-    uint8_t i, chr, last_c = 0;
+    uint8_t i, chr, more, last_c = 0;
+    uint16_t size, start;
+
+    KFF_SEND_BYTE(page);
+    KFF_SEND_BYTE(page >> 8);
+    KFF_SEND_BYTE(textLength);
+    KFF_SEND_BYTE(textLength >> 8);
+    kff_send_reply(REPLY_TEXT_PAGE);
 
     clrscr();
     revers(1);
     textcolor(BACKC);
     gotoxy(0, 0);
-    KFF_READ_PTR = 0;
     for (i=0; i<DIR_NAME_LENGTH; i++)
     {
         cputc(KFF_DATA);
@@ -295,7 +306,10 @@ static void showTextPage(uint16_t page)
     textcolor(TEXTC);
     gotoxy(0, 1);
 
-    KFF_READ_PTR = pageBuffer[page];
+    kff_receive_data(&textPage, 2);
+    kff_receive_data(&more, 1);
+    kff_receive_data(&size, 2);
+    start = KFF_READ_PTR;
     while (true)
     {
         chr = KFF_DATA;
@@ -328,19 +342,18 @@ static void showTextPage(uint16_t page)
         last_c = chr;
     }
 
-    pageBuffer[page + 1] = KFF_READ_PTR;
+    // The firmware finds the start of the next page from the length shown
+    textLength = KFF_READ_PTR - start;
+    return more || KFF_DATA;
 }
 
 static void textReaderLoop(void)
 {
     uint8_t c;
-    uint16_t size, page = 0;
+    bool more;
 
-    KFF_READ_PTR = DIR_NAME_LENGTH;
-    kff_receive_data(&size, 2);
-    size++;
-    pageBuffer[0] = KFF_READ_PTR;
-    showTextPage(0);
+    textLength = 0;
+    more = showTextPage(0);
 
     waitRelease();
     while (true)
@@ -357,23 +370,22 @@ static void textReaderLoop(void)
             case CH_HOME:
             case CH_FIRE_LEFT:
             case CH_FIRE_UP:
-                page = 0;
-                showTextPage(page);
+                more = showTextPage(0);
                 break;
 
             case CH_CURS_DOWN:
             case CH_CURS_RIGHT:
-                if (KFF_READ_PTR < size && page < (sizeof(Directory)/2))
+                if (more)
                 {
-                    showTextPage(++page);
+                    more = showTextPage(textPage + 1);
                 }
                 break;
 
             case CH_CURS_LEFT:
             case CH_CURS_UP:
-                if (page)
+                if (textPage)
                 {
-                    showTextPage(--page);
+                    more = showTextPage(textPage - 1);
                 }
                 break;
 
@@ -0,0 +1,180 @@
+;
+; Copyright (c) 2019-2025 Kim Jørgensen
+;
+; This software is provided 'as-is', without any express or implied
+; warranty.  In no event will the authors be held liable for any damages
+; arising from the use of this software.
+;
+; Permission is granted to anyone to use this software for any purpose,
+; including commercial applications, and to alter it and redistribute it
+; freely, subject to the following restrictions:
+;
+; 1. The origin of this software must not be misrepresented; you must not
+;    claim that you wrote the original software. If you use this software
+;    in a product, an acknowledgment in the product documentation would be
+;    appreciated but is not required.
+; 2. Altered source versions must be plainly marked as such, and must not be
+;    misrepresented as being the original software.
+; 3. This notice may not be removed or altered from any source distribution.
+;
+; Snapshot of the C64 in disk mode. The firmware will NMI the C64 in Ultimax
+; mode when the special button is pressed. The C64 RAM is transferred using
+; DMA while the CPU waits in this code.
+;
+
+KFF_DATA        = $de00
+KFF_COMMAND     = $de01
+KFF_CONTROL     = $de02
+KFF_RAM_TST     = $de03
+KFF_WRITE_LPTR  = $de06
+KFF_WRITE_HPTR  = $de07
+
+KFF_ULTIMAX     = $40
+
+; Align with commands.h
+REPLY_SNAPSHOT  = $9a
+
+VIC_REGS        = $2f                   ; $d000-$d02e
+CIA1            = $dc00
+CIA2            = $dd00
+COLOR_RAM       = $d800
+
+; =============================================================================
+;
+; void snapshot_restore(void);
+;
+; Restore the I/O state and resume the snapshot after RAM has been written.
+; Placed at ROML as this is visible in both 16k and Ultimax mode.
+;
+; =============================================================================
+.segment "LOWCODE"
+.proc   _snapshot_restore
+.export _snapshot_restore
+_snapshot_restore:
+        sei
+        lda #KFF_ULTIMAX
+        sta KFF_CONTROL
+        jmp snapshot_restore_io
+.endproc
+
+; =============================================================================
+;
+; NMI handler in Ultimax mode. Send the CPU registers and the I/O state
+;
+; =============================================================================
+.segment "ULTIMAX"
+.proc   snapshot_nmi
+.export snapshot_nmi
+snapshot_nmi:
+        sta KFF_RAM_TST                 ; Save A and reset write pointer
+        lda #$00
+        sta KFF_WRITE_LPTR
+        sta KFF_WRITE_HPTR
+
+        lda KFF_RAM_TST                 ; Send A, X, Y and SP
+        sta KFF_DATA
+        stx KFF_DATA
+        sty KFF_DATA
+        tsx
+        stx KFF_DATA
+
+        lda $00                         ; Send 6510 I/O port
+        sta KFF_DATA
+        lda $01
+        sta KFF_DATA
+
+        ldx #$00                        ; Send VIC-II registers
+:       lda $d000,x
+        sta KFF_DATA
+        inx
+        cpx #VIC_REGS
+        bne :-
+
+        ldx #$00                        ; Send CIA ports
+:       lda CIA1,x
+        sta KFF_DATA
+        lda CIA2,x
+        sta KFF_DATA
+        inx
+        cpx #$04
+        bne :-
+
+        ldx #$00                        ; Send color RAM
+:       lda COLOR_RAM,x
+        sta KFF_DATA
+        lda COLOR_RAM + $100,x
+        sta KFF_DATA
+        lda COLOR_RAM + $200,x
+        sta KFF_DATA
+        lda COLOR_RAM + $300,x
+        sta KFF_DATA
+        inx
+        bne :-
+        ; fall through
+.endproc
+
+; -----------------------------------------------------------------------------
+; Wait for RAM to be transferred and return from the NMI
+; -----------------------------------------------------------------------------
+.proc   snapshot_wait
+snapshot_wait:
+        lda #$2f                        ; Make all RAM visible for DMA
+        sta $00
+        lda #$34
+        sta $01
+
+        lda #REPLY_SNAPSHOT             ; Send reply
+        sta KFF_COMMAND
+
+:       lda KFF_COMMAND                 ; Wait for the firmware
+        bmi :-
+
+        ldx KFF_DATA                    ; Receive SP
+        txs
+        lda KFF_DATA                    ; Receive 6510 I/O port
+        sta $00
+        lda KFF_DATA
+        sta $01
+        ldy KFF_DATA                    ; Receive Y, X and A
+        ldx KFF_DATA
+        lda KFF_DATA
+
+        ; The firmware will leave Ultimax mode when the PC is read
+        rti
+.endproc
+
+; -----------------------------------------------------------------------------
+; Receive the I/O state
+; -----------------------------------------------------------------------------
+.proc   snapshot_restore_io
+snapshot_restore_io:
+        ldx #$00                        ; Receive VIC-II registers
+:       lda KFF_DATA
+        sta $d000,x
+        inx
+        cpx #VIC_REGS
+        bne :-
+
+        ldx #$00                        ; Receive CIA ports
+:       lda KFF_DATA
+        sta CIA1,x
+        lda KFF_DATA
+        sta CIA2,x
+        inx
+        cpx #$04
+        bne :-
+
+        ldx #$00                        ; Receive color RAM
+:       lda KFF_DATA
+        sta COLOR_RAM,x
+        lda KFF_DATA
+        sta COLOR_RAM + $100,x
+        lda KFF_DATA
+        sta COLOR_RAM + $200,x
+        lda KFF_DATA
+        sta COLOR_RAM + $300,x
+        inx
+        bne :-
+
+        jmp snapshot_wait
+.endproc